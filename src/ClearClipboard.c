@@ -23,52 +23,206 @@
 #include <shellapi.h>
 #include <shlwapi.h>
 #include <Mmsystem.h>
+#include <TlHelp32.h>
+#include <WtsApi32.h>
+#if defined(_M_X64) || defined(_M_IX86)
+#include <intrin.h>
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#endif
 
 #include "Version.h"
+#include "Schedule.h"
+#include "Scan.h"
+#include "Hash.h"
+#include "Managers.h"
+
+// Primitives of the log ring
+#define LOG_CAS(X,Y,Z) InterlockedCompareExchange((X),(Y),(Z))
+#define LOG_XCHG(X,Y) InterlockedExchange((X),(Y))
+#define LOG_INC(X) InterlockedIncrement((X))
+#define LOG_SNPRINTF wnsprintfA
+#include "Log.h"
+
+// Primitive of the configuration parser
+#define CONFIG_COMPARE lstrcmpiW
+#include "Config.h"
 
 // Defaults
 #define DEFAULT_TIMEOUT 30000U
 #define DEFAULT_SOUND_LEVEL 1U
+#define DEFAULT_RETRY_TIMEOUT 1000U
 
 // Const
 #define MUTEX_NAME L"{E19E5CE1-5EF2-4C10-843D-E79460920A4A}"
 #define CLASS_NAME L"{6D6CB8E6-BFEE-40A1-A6B2-2FF34C43F3F8}"
 #define TIMER_ID 0x5281CC36
+#define RETRY_MAX_DELAY 250U
+#define UPDATE_DELAY 20U
+#define LOG_LINE_SIZE 256U
+#define TRACE_FILE_VERSION 1U
+#define HISTOGRAM_BUCKETS 24U
+#define METRICS_BUFFER_SIZE 16384U
+#define METRICS_TIMEOUT 1000U
+#define CONFIG_MAX_SIZE 0x10000U
+#define CONFIG_RELOAD_DELAY 250U
+#define RISK_SCAN_INTERVAL 60000U
+#define SOUND_MAX_SIZE 0x100000U
+#define NOTIFY_QUEUE_SIZE 4U
+#define NOTIFY_TEXT_SIZE 512U
+#define NOTIFY_RATE_LIMIT 900000U
+#define FINGERPRINT_LIMIT 0x10000U
+#define CONTROL_MAGIC 0x4C544343UL
+#define CONTROL_VERSION 1U
+#define CONTROL_MAX_COMMANDS 16U
+#define CONTROL_TIMEOUT 1000U
 #define ID_NOTIFYICON 0x8EF73CE1
 #define ID_HOTKEY 0xBC86
 #define WM_NOTIFYICON (WM_APP+101U)
+#define WM_SETTINGS_CHANGED (WM_APP+102U)
+#define WM_CONTROL (WM_APP+103U)
 #define MENU1_ID 0x1A5C
 #define MENU2_ID 0x6810
 #define MENU3_ID 0x46C3
 #define MENU4_ID 0x38D6
 #define WIN32_WINNT_WINTHRESHOLD 0x0A00
-
-// Common text formats
-const WCHAR *const TEXT_FORMATS[12U] =
-{
-	L"CSV",
-	L"HTML (Hyper Text Markup Language)",
-	L"HTML Format",
-	L"RTF As Text",
-	L"Rich Text Format",
-	L"Rich Text Format Without Objects",
-	L"RichEdit Text and Objects",
-	L"text/csv",
-	L"text/html",
-	L"text/plain",
-	L"text/richtext",
-	L"text/uri-list"
+#define FORMAT_TABLE_SIZE 64U
+#define SCAN_LIMIT 0x400000U
+
+// Scheduler slots (in dispatch order)
+#define SLOT_UPDATE 0U
+#define SLOT_RETRY 1U
+#define SLOT_DEADLINE 2U
+#define SLOT_COUNT 3U
+
+// Clipboard risks
+#define RISK_HISTORY_SERVICE 0x1
+#define RISK_DITTO 0x2
+#define RISK_CLIPBOARD_MANAGER 0x4
+
+// Notification categories
+#define NOTIFY_HISTORY_SERVICE 0U
+#define NOTIFY_DITTO 1U
+#define NOTIFY_CLIPBOARD_MANAGER 2U
+#define NOTIFY_CATEGORY_COUNT 3U
+
+// Notification styles
+#define NOTIFY_STYLE_MESSAGE_BOX 0U
+#define NOTIFY_STYLE_BALLOON 1U
+#define NOTIFY_STYLE_LOG_ONLY 2U
+
+// Control commands
+#define CONTROL_NOP 0U
+#define CONTROL_CLEAR 1U
+#define CONTROL_HALT 2U
+#define CONTROL_RESUME 3U
+#define CONTROL_SET_TIMEOUT 4U
+#define CONTROL_GET_STATE 5U
+#define CONTROL_GET_REMAINING 6U
+#define CONTROL_GET_TIMEOUT 7U
+#define CONTROL_CLOSE 8U
+
+// Control status
+#define CONTROL_OK 0U
+#define CONTROL_UNKNOWN 1U
+#define CONTROL_FAILED 2U
+
+// Control state flags
+#define STATE_HALTED 0x1
+#define STATE_CLEAR_PENDING 0x2
+#define STATE_ARMED 0x4
+#define STATE_SKIPPED 0x8
+
+// Trace events
+#define EVENT_START 1U
+#define EVENT_STOP 2U
+#define EVENT_UPDATE 3U
+#define EVENT_SELF_UPDATE 4U
+#define EVENT_TIMER 5U
+#define EVENT_RETRY 6U
+#define EVENT_CLEAR 7U
+#define EVENT_HOTKEY 8U
+#define EVENT_COMMAND 9U
+#define EVENT_ITEM 10U
+#define EVENT_SESSION 11U
+
+// Session events
+#define SESSION_LOCK 1U
+#define SESSION_UNLOCK 2U
+#define SESSION_SUSPEND 3U
+#define SESSION_RESUME 4U
+
+// Format classes
+#define FORMAT_CLASS_NONE 0U
+#define FORMAT_CLASS_TEXT 1U
+#define FORMAT_CLASS_RICH 2U
+#define FORMAT_CLASS_IMAGE 3U
+#define FORMAT_CLASS_FILES 4U
+#define FORMAT_CLASS_OTHER 5U
+#define FORMAT_CLASS_COUNT 6U
+
+// Common registered formats
+static const struct
+{
+	const WCHAR *name;
+	BYTE format_class;
+}
+REGISTERED_FORMATS[32U] =
+{
+	{ L"CSV",                               FORMAT_CLASS_TEXT  },
+	{ L"text/csv",                          FORMAT_CLASS_TEXT  },
+	{ L"text/plain",                        FORMAT_CLASS_TEXT  },
+	{ L"text/uri-list",                     FORMAT_CLASS_TEXT  },
+	{ L"UniformResourceLocator",            FORMAT_CLASS_TEXT  },
+	{ L"UniformResourceLocatorW",           FORMAT_CLASS_TEXT  },
+	{ L"HTML (Hyper Text Markup Language)", FORMAT_CLASS_RICH  },
+	{ L"HTML Format",                       FORMAT_CLASS_RICH  },
+	{ L"RTF As Text",                       FORMAT_CLASS_RICH  },
+	{ L"Rich Text Format",                  FORMAT_CLASS_RICH  },
+	{ L"Rich Text Format Without Objects",  FORMAT_CLASS_RICH  },
+	{ L"RichEdit Text and Objects",         FORMAT_CLASS_RICH  },
+	{ L"text/html",                         FORMAT_CLASS_RICH  },
+	{ L"text/richtext",                     FORMAT_CLASS_RICH  },
+	{ L"GIF",                               FORMAT_CLASS_IMAGE },
+	{ L"JFIF",                              FORMAT_CLASS_IMAGE },
+	{ L"PNG",                               FORMAT_CLASS_IMAGE },
+	{ L"image/bmp",                         FORMAT_CLASS_IMAGE },
+	{ L"image/gif",                         FORMAT_CLASS_IMAGE },
+	{ L"image/jpeg",                        FORMAT_CLASS_IMAGE },
+	{ L"image/png",                         FORMAT_CLASS_IMAGE },
+	{ L"image/svg+xml",                     FORMAT_CLASS_IMAGE },
+	{ L"FileContents",                      FORMAT_CLASS_FILES },
+	{ L"FileGroupDescriptor",               FORMAT_CLASS_FILES },
+	{ L"FileGroupDescriptorW",              FORMAT_CLASS_FILES },
+	{ L"FileName",                          FORMAT_CLASS_FILES },
+	{ L"FileNameW",                         FORMAT_CLASS_FILES },
+	{ L"Shell IDList Array",                FORMAT_CLASS_FILES },
+	{ L"DataObject",                        FORMAT_CLASS_NONE  },
+	{ L"Locale",                            FORMAT_CLASS_NONE  },
+	{ L"Ole Private Data",                  FORMAT_CLASS_NONE  },
+	{ L"Preferred DropEffect",              FORMAT_CLASS_NONE  }
 };
 
 // User settings
 static UINT cfg_timeout = DEFAULT_TIMEOUT;
 static BOOL cfg_textual_only = FALSE;
+static UINT cfg_class_timeout[FORMAT_CLASS_COUNT] = { 0U, DEFAULT_TIMEOUT, DEFAULT_TIMEOUT, DEFAULT_TIMEOUT, DEFAULT_TIMEOUT, DEFAULT_TIMEOUT };
+static UINT cfg_sensitive_timeout = 0U;
 static UINT cfg_sound_enabled = DEFAULT_SOUND_LEVEL;
+static UINT cfg_retry_timeout = DEFAULT_RETRY_TIMEOUT;
 static BOOL cfg_halted = FALSE;
 static WORD cfg_hotkey = 0U;
 static BOOL cfg_ignore_warning = FALSE;
 static BOOL cfg_silent = FALSE;
 static BOOL cfg_hidden = FALSE;
+static UINT cfg_warning_style = NOTIFY_STYLE_MESSAGE_BOX;
+static BOOL cfg_ignore_recopy = FALSE;
+static BOOL cfg_clear_on_lock = FALSE;
+static BOOL cfg_clear_on_suspend = FALSE;
+static BOOL cfg_metrics = FALSE;
+static BOOL cfg_control = TRUE;
+static const WCHAR *cfg_log_file = NULL;
+static const WCHAR *cfg_trace_file = NULL;
 #ifndef _DEBUG
 static UINT cfg_debug = 0U;
 #else
@@ -77,44 +231,167 @@ static const UINT cfg_debug = 2U;
 
 // Global variables
 static ULONGLONG g_tickCount = 0U;
-static UINT g_text_formats[16U] = { CF_TEXT, CF_OEMTEXT, CF_UNICODETEXT, CF_DSPTEXT, 0U };
+static UINT g_item_timeout = DEFAULT_TIMEOUT;
+static struct { ULONGLONG due[SLOT_COUNT], armed_due; UINT active; BOOL armed, dispatching; } g_scheduler;
+static BOOL g_skip_current = FALSE;
+static struct { BOOL pending, force; UINT sound_level, retries, delay; ULONGLONG start; } g_clear = { FALSE, FALSE, 0U, 0U, 0U, 0U };
+static struct { BOOL pending; UINT burst; ULONGLONG start; } g_update = { FALSE, 0U, 0U };
+static struct { UINT notifications, items, self_updates, recopies; } g_update_stats = { 0U, 0U, 0U, 0U };
+static DWORD g_fingerprint = 0U;
+static DWORD g_sequence = 0U;
+static DWORD g_own_sequence = 0U;
+static struct { DWORD sequence; UINT classes; BOOL unicode_text; DWORD formats; UINT queries, saved; } g_inventory = { 0U, 0U, FALSE, 0U, 0U, 0U };
+static struct { UINT format; BYTE format_class; } g_format_table[FORMAT_TABLE_SIZE];
+static BOOL g_uniform_policy = TRUE;
+static BOOL g_have_sse2 = FALSE;
 static UINT g_taskbar_created = 0U;
-static const WCHAR *g_sound_file = NULL;
+static struct { BYTE *data; DWORD duration; ULONGLONG end; } g_sound = { NULL, 0U, 0U };
 static const WCHAR *g_config_path = NULL;
 static HICON g_app_icon[2U] = { NULL, NULL };
 static HMENU g_context_menu = NULL;
-static HANDLE g_msgbox_thread = NULL;
+
+// Configuration
+static config_t *g_config = NULL;
+
+// Reloadable settings
+typedef struct
+{
+	UINT timeout, class_timeout[FORMAT_CLASS_COUNT], sensitive_timeout, sound_enabled, retry_timeout;
+	BOOL textual_only;
+}
+settings_t;
+static settings_t *volatile g_pending_settings = NULL;
+
+// Named pipes
+typedef struct
+{
+	SECURITY_ATTRIBUTES attributes;
+	SECURITY_DESCRIPTOR descriptor;
+	DWORD_PTR acl[(sizeof(ACL) + sizeof(ACCESS_ALLOWED_ACE) + SECURITY_MAX_SID_SIZE) / sizeof(DWORD_PTR) + 1U];
+}
+pipe_security_t;
+
+// Metrics
+typedef struct
+{
+	volatile LONG buckets[HISTOGRAM_BUCKETS];
+	volatile LONG count;
+	volatile LONGLONG sum;
+}
+histogram_t;
+static struct
+{
+	BOOL enabled;
+	DWORD qpc_per_usec;
+	volatile LONG clears[3U], retries, messages;
+	histogram_t clear_lateness, open_contention, wndproc_time;
+}
+g_metrics;
+
+// Control protocol
+typedef struct
+{
+	WORD opcode, status;
+	DWORD value;
+}
+control_command_t;
+typedef struct
+{
+	DWORD magic;
+	WORD version, count;
+	control_command_t commands[CONTROL_MAX_COMMANDS];
+}
+control_message_t;
+typedef struct
+{
+	volatile LONG refs;
+	control_message_t message;
+}
+control_request_t;
+#define CONTROL_MESSAGE_SIZE(N) ((DWORD)(FIELD_OFFSET(control_message_t, commands) + ((N) * sizeof(control_command_t))))
+static control_message_t g_control_request;
 
 // Forward declaration
 static LRESULT CALLBACK my_wnd_proc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam);
+static LRESULT process_message(const HWND hWnd, const UINT message, const WPARAM wParam, const LPARAM lParam);
+static void clipboard_updated(const HWND hwnd);
+static void process_update(const HWND hwnd);
+static BOOL update_timer(const HWND hwnd);
+static void process_deadline(const HWND hwnd);
+static void set_halted(const HWND hwnd, const BOOL halted);
+static void session_changed(const HWND hwnd, const UINT event);
+static BOOL scheduler_set(const HWND hwnd, const UINT slot, const UINT delay);
+static void scheduler_cancel(const HWND hwnd, const UINT slot);
+static void scheduler_dispatch(const HWND hwnd);
+static void request_clear(const HWND hwnd, const BOOL force, const UINT sound_level);
+static void process_clear(const HWND hwnd);
 static UINT clear_clipboard(const BOOL force);
 static BOOL is_textual_format(void);
+static void update_inventory(const BOOL is_open);
+static void load_settings(const config_t *const config, settings_t *const settings);
+static void apply_settings(const settings_t *const settings);
+static BOOL config_watch_start(const HWND hwnd);
+static void config_watch_stop(void);
+static UINT get_format_class(const UINT format);
+static UINT get_item_classes(void);
+static UINT get_item_timeout(void);
+static BOOL is_clear_forced(void);
+static BOOL contains_sensitive_text(void);
+static DWORD get_item_fingerprint(void);
 static BOOL check_clipboard_history(void);
 static BOOL recheck_clipboard_history(void);
+static BOOL risk_detector_start(void);
+static void risk_detector_stop(void);
 static UINT parse_arguments(const WCHAR *const command_line);
 static BOOL update_autorun_entry(const BOOL remove);
 static BOOL create_shell_notify_icon(const HWND hwnd, const BOOL halted);
 static BOOL update_shell_notify_icon(const HWND hwnd, const BOOL halted);
 static BOOL delete_shell_notify_icon(const HWND hwnd);
+static BOOL show_shell_notify_balloon(const HWND hwnd, const WCHAR *const title, const WCHAR *const text);
 static BOOL about_screen(const BOOL first_run);
 static BOOL show_disclaimer(void);
 static BOOL play_sound_effect(void);
+static BOOL sound_load(const WCHAR *const path);
+static void sound_unload(void);
 static WCHAR *get_configuration_path(void);
 static WCHAR *get_executable_path(void);
 static WCHAR *get_system_directory(void);
 static BOOL file_exists(const WCHAR *const path);
-static int get_config_value(const WCHAR *const path, const WCHAR *const name, const int default_value, const int min_value, const int max_value);
+static config_t *config_load(const WCHAR *const path);
+static int get_config_value(const config_t *const config, const WCHAR *const name, const int default_value, const int min_value, const int max_value);
+static UINT get_config_timeout(const config_t *const config, const WCHAR *const name, const UINT default_value);
 static DWORD reg_read_value(const HKEY root, const WCHAR *const path, const WCHAR *const name, const DWORD default_value);
 static WCHAR *reg_read_string(const HKEY root, const WCHAR *const path, const WCHAR *const name);
 static BOOL reg_write_value(const HKEY root, const WCHAR *const path, const WCHAR *const name, const DWORD value);
 static BOOL reg_write_string(const HKEY root, const WCHAR *const path, const WCHAR *const name, const WCHAR *const text);
 static BOOL reg_delete_value(const HKEY root, const WCHAR *const path, const WCHAR *const name);
 static BOOL find_running_service(const WCHAR *const name_prefix);
-static BOOL messagebox_async(const WCHAR *const text, const WCHAR *const caption, const DWORD style);
+static BOOL notify_start(const HWND hwnd);
+static void notify_stop(void);
+static BOOL notify_post(const UINT category, const WCHAR *const text);
 static BOOL stop_thread(const HANDLE thread);
 static WCHAR *quote_string(const WCHAR *const text);
 static WCHAR *concat_strings(const WCHAR *const text_1, const WCHAR *const text_2);
-static void output_formatted_string(const char *const format, ...);
+static void get_pipe_name(WCHAR *const buffer, const UINT size, const WCHAR *const suffix);
+static SECURITY_ATTRIBUTES *get_pipe_security(pipe_security_t *const security);
+static OVERLAPPED *pipe_overlapped(OVERLAPPED *const overlapped, const HANDLE event);
+static BOOL pipe_wait(const HANDLE pipe, OVERLAPPED *const overlapped, const BOOL result, const HANDLE stop, const DWORD timeout, DWORD *const bytes);
+static BOOL pipe_connect(const HANDLE pipe, OVERLAPPED *const overlapped, const HANDLE stop);
+static BOOL log_start(void);
+static void log_stop(void);
+static void log_write(const char *const format, ...);
+static void trace_event(const UINT type, const UINT arg0, const DWORD arg1, const DWORD arg2);
+static void trace_item(void);
+static BOOL metrics_start(void);
+static void histogram_record(histogram_t *const histogram, const DWORD value);
+static DWORD get_elapsed_usec(const LARGE_INTEGER *const start, const LARGE_INTEGER *const end);
+static void metrics_stop(void);
+static BOOL control_add(control_message_t *const message, const WORD opcode, const DWORD value);
+static UINT control_transact(control_message_t *const message);
+static UINT control_client(control_message_t *const message);
+static BOOL control_start(const HWND hwnd);
+static void control_stop(void);
+static void process_control(const HWND hwnd, control_request_t *const request);
 static BOOL is_windows_version_or_greater(const WORD wMajorVersion, const WORD wMinorVersion, const WORD wServicePackMajor);
 
 // ==========================================================================
@@ -129,22 +406,44 @@ static BOOL is_windows_version_or_greater(const WORD wMajorVersion, const WORD w
 #define _OUTPUT_DBGSTR(X,Y) do \
 { \
 	if (cfg_debug >= (X)) \
-		OutputDebugStringA("ClearClipboard -- " Y "\n"); \
+		log_write("%s", "ClearClipboard -- " Y "\n"); \
 } \
 while(0)
 #define DEBUG(X) _OUTPUT_DBGSTR(1U, X)
 #define TRACE(X) _OUTPUT_DBGSTR(2U, X)
 
-// Formatted output
+// Formatted output (string arguments must be static data, see log_write)
 #define _OUTPUT_DBGSTR2(X,Y,...) do \
 { \
 	if (cfg_debug >= (X)) \
-		output_formatted_string("ClearClipboard -- " Y "\n", __VA_ARGS__); \
+		log_write("ClearClipboard -- " Y "\n", __VA_ARGS__); \
 } \
 while(0)
 #define DEBUG2(X,...) _OUTPUT_DBGSTR2(1U, X, __VA_ARGS__)
 #define TRACE2(X,...) _OUTPUT_DBGSTR2(2U, X, __VA_ARGS__)
 
+// Binary event trace
+#define RECORD_EVENT(T,A,B,C) do \
+{ \
+	if(cfg_trace_file) \
+		trace_event((T), (A), (B), (C)); \
+} \
+while(0)
+
+// Metrics
+#define METRICS_COUNTER(X,Y) do \
+{ \
+	if(g_metrics.enabled) \
+		InterlockedExchangeAdd(&g_metrics.X, (Y)); \
+} \
+while(0)
+#define METRICS_HISTOGRAM(X,Y) do \
+{ \
+	if(g_metrics.enabled) \
+		histogram_record(&g_metrics.X, (Y)); \
+} \
+while(0)
+
 // Play sound
 #define PLAY_SOUND(X) do \
 { \
@@ -171,7 +470,6 @@ while(0)
 
 // Message box
 #define MESSAGE_BOX(X,Y) MessageBoxW(NULL, (X), L"ClearClipboard v" WTEXT(VERSION_STR), (Y) | MB_SETFOREGROUND | MB_TOPMOST)
-#define MESSAGE_BOX_ASYNC(X,Y) messagebox_async((X), L"ClearClipboard v" WTEXT(VERSION_STR), (Y) | MB_SETFOREGROUND | MB_TOPMOST)
 
 // Optional message
 #define SHOW_MESSAGE(X,Y) do \
@@ -184,6 +482,9 @@ while(0)
 // Boolify
 #define BOOLIFY(X) ((X) ? "true" : "false")
 
+// Rotate left (32-Bit)
+#define ROTL32(X,N) (((X) << (N)) | ((X) >> (32U - (N))))
+
 // ==========================================================================
 // Entry point function
 // ==========================================================================
@@ -215,11 +516,12 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 {
 	int result = 0, status = -1;
 	UINT mode = 0U;
-	HANDLE mutex = NULL, sf_lock = INVALID_HANDLE_VALUE;
+	HANDLE mutex = NULL;
+	WCHAR *sound_file = NULL;
 	HWND hwnd = NULL;
-	BOOL have_listener = FALSE;
-	UINT_PTR timer_id = (UINT_PTR)NULL;
+	BOOL have_listener = FALSE, have_session_notification = FALSE;
 	WNDCLASSW wcl;
+	settings_t settings;
 	MSG msg;
 
 	// Unused params
@@ -232,27 +534,50 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 
 	// Parse CLI arguments
 	mode = parse_arguments(lpCmdLine);
-	DEBUG("ClearClipboard v" VERSION_STR " [" __DATE__ "]");
 
 	// Check argument
-	if(mode > 4U)
+	if(mode > 5U)
 	{
 		MESSAGE_BOX(L"Invalid command-line argument(s). Exiting!", MB_ICONERROR);
 		return -1;
 	}
 
+	// Start logging thread
+	if(cfg_debug || cfg_trace_file)
+	{
+		log_start();
+	}
+
+	DEBUG("ClearClipboard v" VERSION_STR " [" __DATE__ "]");
+
+	// Send control commands to the running instance, if it was requested
+	if(mode == 5U)
+	{
+		const UINT ret = control_client(&g_control_request);
+		DEBUG("goodbye.");
+		log_stop();
+		return (int)ret;
+	}
+
 	// Close running instances, if it was requested
 	if((mode == 1U) || (mode == 2U))
 	{
 		DEBUG("closing all running instances...");
-		while(hwnd = FindWindowExW(NULL, hwnd, CLASS_NAME, NULL))
+		g_control_request.count = 0U;
+		control_add(&g_control_request, CONTROL_CLOSE, 0U);
+		if(control_transact(&g_control_request))
 		{
-			DEBUG2("sending WM_CLOSE message to: hwnd=%p", hwnd);
-			SendMessageW(hwnd, WM_CLOSE, 0U, 0U);
+			DEBUG("control pipe not available, falling back to WM_CLOSE...");
+			while(hwnd = FindWindowExW(NULL, hwnd, CLASS_NAME, NULL))
+			{
+				DEBUG2("sending WM_CLOSE message to: hwnd=%p", hwnd);
+				SendMessageW(hwnd, WM_CLOSE, 0U, 0U);
+			}
 		}
 		if(mode == 1U)
 		{
 			DEBUG("goodbye.");
+			log_stop();
 			return 0;
 		}
 	}
@@ -270,6 +595,7 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 			SHOW_MESSAGE((mode > 3U) ? L"Failed to remove autorun entry!" : L"Failed to create autorun entry!", MB_ICONWARNING);
 		}
 		DEBUG("goodbye.");
+		log_stop();
 		return success ? 0 : 1;
 	}
 
@@ -294,13 +620,23 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 		if(file_exists(g_config_path))
 		{
 			DEBUG("reading configuration file...");
-			cfg_timeout = (UINT) get_config_value(g_config_path, L"Timeout", DEFAULT_TIMEOUT, 1000, 3600000/*1h*/);
-			cfg_textual_only = !!get_config_value(g_config_path, L"TextOnly", FALSE, FALSE, TRUE);
-			cfg_sound_enabled = (UINT) get_config_value(g_config_path, L"Sound", DEFAULT_SOUND_LEVEL, 0, 2);
-			cfg_halted = !!get_config_value(g_config_path, L"Halted", FALSE, FALSE, TRUE);
-			cfg_hotkey = (WORD) get_config_value(g_config_path, L"Hotkey", 0U, 0U, 0x8FF);
-			cfg_ignore_warning = !!get_config_value(g_config_path, L"DisableWarningMessages", FALSE, FALSE, TRUE);
-			cfg_hidden = !!get_config_value(g_config_path, L"HideNotificationIcon", FALSE, FALSE, TRUE);
+			if(g_config = config_load(g_config_path))
+			{
+				cfg_halted = !!get_config_value(g_config, L"Halted", FALSE, FALSE, TRUE);
+				cfg_hotkey = (WORD) get_config_value(g_config, L"Hotkey", 0U, 0U, 0x8FF);
+				cfg_ignore_warning = !!get_config_value(g_config, L"DisableWarningMessages", FALSE, FALSE, TRUE);
+				cfg_hidden = !!get_config_value(g_config, L"HideNotificationIcon", FALSE, FALSE, TRUE);
+				cfg_warning_style = (UINT) get_config_value(g_config, L"WarningStyle", NOTIFY_STYLE_MESSAGE_BOX, NOTIFY_STYLE_MESSAGE_BOX, NOTIFY_STYLE_LOG_ONLY);
+				cfg_ignore_recopy = !!get_config_value(g_config, L"IgnoreRecopy", FALSE, FALSE, TRUE);
+				cfg_clear_on_lock = !!get_config_value(g_config, L"ClearOnLock", FALSE, FALSE, TRUE);
+				cfg_clear_on_suspend = !!get_config_value(g_config, L"ClearOnSuspend", FALSE, FALSE, TRUE);
+				cfg_metrics = !!get_config_value(g_config, L"MetricsPipe", FALSE, FALSE, TRUE);
+				cfg_control = !!get_config_value(g_config, L"ControlPipe", TRUE, FALSE, TRUE);
+			}
+			else
+			{
+				DEBUG("failed to read the configuration file!");
+			}
 		}
 		else
 		{
@@ -308,14 +644,31 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 		}
 	}
 
+	// Set up reloadable settings
+	load_settings(g_config, &settings);
+	apply_settings(&settings);
+
 	// Dump config variables
 	DEBUG2("config: timeout=%u", cfg_timeout);
 	DEBUG2("config: textual_only=%s", BOOLIFY(cfg_textual_only));
+	DEBUG2("config: timeout_text=%u", cfg_class_timeout[FORMAT_CLASS_TEXT]);
+	DEBUG2("config: timeout_rich=%u", cfg_class_timeout[FORMAT_CLASS_RICH]);
+	DEBUG2("config: timeout_image=%u", cfg_class_timeout[FORMAT_CLASS_IMAGE]);
+	DEBUG2("config: timeout_files=%u", cfg_class_timeout[FORMAT_CLASS_FILES]);
+	DEBUG2("config: timeout_other=%u", cfg_class_timeout[FORMAT_CLASS_OTHER]);
+	DEBUG2("config: timeout_sensitive=%u", cfg_sensitive_timeout);
 	DEBUG2("config: halted=%s", BOOLIFY(cfg_halted));
 	DEBUG2("config: sound_enabled=%u", cfg_sound_enabled);
+	DEBUG2("config: retry_timeout=%u", cfg_retry_timeout);
 	DEBUG2("config: hotkey=0x%03X", (UINT)cfg_hotkey);
 	DEBUG2("config: ignore_warning=%s", BOOLIFY(cfg_ignore_warning));
 	DEBUG2("config: cfg_hidden=%s", BOOLIFY(cfg_hidden));
+	DEBUG2("config: warning_style=%u", cfg_warning_style);
+	DEBUG2("config: ignore_recopy=%s", BOOLIFY(cfg_ignore_recopy));
+	DEBUG2("config: clear_on_lock=%s", BOOLIFY(cfg_clear_on_lock));
+	DEBUG2("config: clear_on_suspend=%s", BOOLIFY(cfg_clear_on_suspend));
+	DEBUG2("config: metrics=%s", BOOLIFY(cfg_metrics));
+	DEBUG2("config: control=%s", BOOLIFY(cfg_control));
 
 	// Show the disclaimer message
 	if(!show_disclaimer())
@@ -324,9 +677,16 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 	}
 
 	// Check clipboard system configuration
-	if(!(cfg_ignore_warning || check_clipboard_history()))
+	if(!cfg_ignore_warning)
 	{
-		ERROR_EXIT(4);
+		if(!check_clipboard_history())
+		{
+			ERROR_EXIT(4);
+		}
+		if(!risk_detector_start())
+		{
+			DEBUG("failed to start the risk detector!");
+		}
 	}
 
 	// Print status
@@ -338,14 +698,30 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 		ChangeWindowMessageFilter(g_taskbar_created, MSGFLT_ADD);
 	}
 
+	// Detect CPU features
+#if defined(_M_X64)
+	g_have_sse2 = TRUE;
+#elif defined(HAVE_SSE2)
+	g_have_sse2 = IsProcessorFeaturePresent(PF_XMMI64_INSTRUCTIONS_AVAILABLE);
+#endif
+
 	// Register common clipboard formats
-	if(cfg_textual_only)
 	{
 		size_t i;
-		for(i = 0U; i < _countof(TEXT_FORMATS); ++i)
+		for(i = 0U; i < _countof(REGISTERED_FORMATS); ++i)
 		{
-			g_text_formats[4U + i] = RegisterClipboardFormatW(TEXT_FORMATS[i]);
-			TRACE2("text_format[%02u] = 0x%04X", i, g_text_formats[i]);
+			const UINT format = RegisterClipboardFormatW(REGISTERED_FORMATS[i].name);
+			TRACE2("registered_format[%02u] = 0x%04X", i, format);
+			if(format)
+			{
+				UINT slot = format & (FORMAT_TABLE_SIZE - 1U);
+				while(g_format_table[slot].format && (g_format_table[slot].format != format))
+				{
+					slot = (slot + 1U) & (FORMAT_TABLE_SIZE - 1U);
+				}
+				g_format_table[slot].format = format;
+				g_format_table[slot].format_class = REGISTERED_FORMATS[i].format_class;
+			}
 		}
 	}
 
@@ -357,26 +733,21 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 		DEBUG("failed to load icon resource!");
 	}
 
-	// Detect sound file path
-	if(g_sound_file = reg_read_string(HKEY_CURRENT_USER, L"AppEvents\\Schemes\\Apps\\Explorer\\EmptyRecycleBin\\.Current", L""))
+	// Load sound file into memory
+	if(sound_file = reg_read_string(HKEY_CURRENT_USER, L"AppEvents\\Schemes\\Apps\\Explorer\\EmptyRecycleBin\\.Current", L""))
 	{
-		if(g_sound_file[0] && file_exists(g_sound_file))
+		if(sound_file[0] && file_exists(sound_file))
 		{
-			if((sf_lock = CreateFileW(g_sound_file, FILE_GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, 0U, NULL)) != INVALID_HANDLE_VALUE)
-			{
-				SetHandleInformation(sf_lock, HANDLE_FLAG_PROTECT_FROM_CLOSE, HANDLE_FLAG_PROTECT_FROM_CLOSE);
-			}
-			else
+			if(!sound_load(sound_file))
 			{
-				DEBUG("failed to open sound file for reading!");
-				FREE(g_sound_file);
+				DEBUG("failed to load the sound file!");
 			}
 		}
 		else
 		{
 			DEBUG("sound file does not exist!");
-			FREE(g_sound_file);
 		}
+		FREE(sound_file);
 	}
 
 	// Create context menu
@@ -422,6 +793,15 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 		}
 	}
 
+	// Start notification worker
+	if(!cfg_ignore_warning)
+	{
+		if(!notify_start(hwnd))
+		{
+			DEBUG("failed to start the notification worker!");
+		}
+	}
+
 	// Add clipboard listener
 	if(!(have_listener = AddClipboardFormatListener(hwnd)))
 	{
@@ -429,6 +809,12 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 		ERROR_EXIT(8);
 	}
 
+	// Register for session notifications (lock/unlock)
+	if(!(have_session_notification = WTSRegisterSessionNotification(hwnd, NOTIFY_FOR_THIS_SESSION)))
+	{
+		DEBUG("failed to register for session notifications!");
+	}
+
 	// Register hotkey
 	if((cfg_hotkey >= 0x100) && (cfg_hotkey <= 0xFFF) && (LOBYTE(cfg_hotkey) >= 0x08))
 	{
@@ -439,14 +825,44 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 	}
 
 	// Set up window timer
+	g_sequence = GetClipboardSequenceNumber();
 	g_tickCount = GetTickCount64();
-	if(!(timer_id = SetTimer(hwnd, TIMER_ID, max(cfg_timeout / 30U, USER_TIMER_MINIMUM), NULL)))
+	g_item_timeout = get_item_timeout();
+	if(!update_timer(hwnd))
 	{
 		DEBUG("failed to install the window timer!");
 		ERROR_EXIT(9);
 	}
 
+	// Start metrics server
+	if(cfg_metrics)
+	{
+		if(!metrics_start())
+		{
+			DEBUG("failed to start the metrics server!");
+		}
+	}
+
+	// Start control server
+	if(cfg_control)
+	{
+		if(!control_start(hwnd))
+		{
+			DEBUG("failed to start the control server!");
+		}
+	}
+
+	// Watch configuration file
+	if(g_config_path)
+	{
+		if(!config_watch_start(hwnd))
+		{
+			DEBUG("failed to watch the configuration file!");
+		}
+	}
+
 	DEBUG("clipboard monitoring started.");
+	RECORD_EVENT(EVENT_START, 0U, cfg_timeout, g_item_timeout);
 
 	// Message loop
 	while(status = GetMessageW(&msg, NULL, 0, 0) != 0)
@@ -461,13 +877,14 @@ int WINAPI wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdLi
 	}
 
 	DEBUG("shutting down now...");
+	RECORD_EVENT(EVENT_STOP, 0U, 0U, 0U);
 
 clean_up:
 	
 	// Kill timer
-	if(hwnd && timer_id)
+	if(hwnd && g_scheduler.armed)
 	{
-		KillTimer(hwnd, timer_id);
+		KillTimer(hwnd, TIMER_ID);
 	}
 
 	// Delete notification icon
@@ -476,6 +893,12 @@ clean_up:
 		delete_shell_notify_icon(hwnd);
 	}
 
+	// Unregister session notifications
+	if(hwnd && have_session_notification)
+	{
+		WTSUnRegisterSessionNotification(hwnd);
+	}
+
 	// Remove clipboard listener
 	if(hwnd && have_listener)
 	{
@@ -488,12 +911,20 @@ clean_up:
 		DestroyWindow(hwnd);
 	}
 
-	// Stop messaging thread
-	if(g_msgbox_thread)
-	{
-		stop_thread(g_msgbox_thread);
-		CloseHandle(g_msgbox_thread);
-	}
+	// Stop control server
+	control_stop();
+
+	// Stop metrics server
+	metrics_stop();
+
+	// Stop configuration watcher
+	config_watch_stop();
+
+	// Stop risk detector
+	risk_detector_stop();
+
+	// Stop notification worker
+	notify_stop();
 
 	// Free menu resources
 	if(g_context_menu)
@@ -511,11 +942,8 @@ clean_up:
 		DestroyIcon(g_app_icon[1U]);
 	}
 
-	// Free sound file path
-	if(g_sound_file)
-	{
-		FREE(g_sound_file);
-	}
+	// Unload sound
+	sound_unload();
 
 	// Free config file path
 	if(g_config_path)
@@ -523,11 +951,10 @@ clean_up:
 		FREE(g_config_path);
 	}
 
-	// Close sound file
-	if(sf_lock != INVALID_HANDLE_VALUE)
+	// Free configuration
+	if(g_config)
 	{
-		SetHandleInformation(sf_lock, HANDLE_FLAG_PROTECT_FROM_CLOSE, 0U);
-		CloseHandle(sf_lock);
+		FREE(g_config);
 	}
 
 	// Close mutex
@@ -537,6 +964,18 @@ clean_up:
 	}
 	
 	DEBUG("goodbye.");
+
+	// Stop logging thread
+	log_stop();
+	if(cfg_log_file)
+	{
+		FREE(cfg_log_file);
+	}
+	if(cfg_trace_file)
+	{
+		FREE(cfg_trace_file);
+	}
+
 	return result;
 }
 
@@ -545,47 +984,60 @@ clean_up:
 // ==========================================================================
 
 static LRESULT CALLBACK my_wnd_proc(HWND hWnd, UINT message, WPARAM wParam, LPARAM lParam)
+{
+	LARGE_INTEGER start, end;
+	LRESULT result;
+
+	if(!g_metrics.enabled)
+	{
+		return process_message(hWnd, message, wParam, lParam);
+	}
+
+	QueryPerformanceCounter(&start);
+	result = process_message(hWnd, message, wParam, lParam);
+	QueryPerformanceCounter(&end);
+
+	InterlockedIncrement(&g_metrics.messages);
+	histogram_record(&g_metrics.wndproc_time, get_elapsed_usec(&start, &end));
+	return result;
+}
+
+static LRESULT process_message(const HWND hWnd, const UINT message, const WPARAM wParam, const LPARAM lParam)
 {
 	switch(message)
 	{
 	case WM_CLIPBOARDUPDATE:
 		TRACE("WM_CLIPBOARDUPDATE");
-		{
-			const ULONGLONG tickCount = GetTickCount64();
-			if((tickCount > g_tickCount) && ((tickCount - g_tickCount) > 10U))
-			{
-				DEBUG("clipboard content has changed.");
-				g_tickCount = tickCount;
-			}
-		}
+		clipboard_updated(hWnd);
 		break;
 	case WM_TIMER:
 		TRACE("WM_TIMER");
+		if(wParam == TIMER_ID)
+		{
+			scheduler_dispatch(hWnd);
+		}
+		break;
+	case WM_SETTINGS_CHANGED:
+		TRACE("WM_SETTINGS_CHANGED");
 		{
-			const ULONGLONG tickCount = GetTickCount64();
-			if((tickCount > g_tickCount) && ((tickCount - g_tickCount) > cfg_timeout))
+			settings_t *settings = (settings_t*) InterlockedExchangePointer((PVOID volatile*)&g_pending_settings, NULL);
+			if(settings)
 			{
-				DEBUG("timer triggered!");
-				if(!cfg_halted)
-				{
-					const UINT result = clear_clipboard(!cfg_textual_only);
-					if(result)
-					{
-						g_tickCount = tickCount;
-						if(result == 1U)
-						{
-							PLAY_SOUND(2U);
-						}
-					}
-				}
-				else
+				apply_settings(settings);
+				FREE(settings);
+				DEBUG2("configuration reloaded: timeout=%u, textual_only=%s, sound_enabled=%u", cfg_timeout, BOOLIFY(cfg_textual_only), cfg_sound_enabled);
+				if(!g_skip_current)
 				{
-					DEBUG("automatic clearing is halted.");
-					g_tickCount = tickCount;
+					g_item_timeout = get_item_timeout();
 				}
+				update_timer(hWnd);
 			}
 		}
 		break;
+	case WM_CONTROL:
+		TRACE("WM_CONTROL");
+		process_control(hWnd, (control_request_t*)lParam);
+		break;
 	case WM_NOTIFYICON:
 		TRACE("WM_NOTIFYICON");
 		switch(LOWORD(lParam))
@@ -601,11 +1053,8 @@ static LRESULT CALLBACK my_wnd_proc(HWND hWnd, UINT message, WPARAM wParam, LPAR
 		case WM_LBUTTONDBLCLK:
 			TRACE("--> WM_LBUTTONDBLCLK");
 			DEBUG("manual clearing has been triggered.");
-			if(clear_clipboard(TRUE))
-			{
-				g_tickCount = GetTickCount64();
-				PLAY_SOUND(1U);
-			}
+			RECORD_EVENT(EVENT_COMMAND, 0U, 0U, 0U);
+			request_clear(hWnd, TRUE, 1U);
 			break;
 		}
 		break;
@@ -617,28 +1066,21 @@ static LRESULT CALLBACK my_wnd_proc(HWND hWnd, UINT message, WPARAM wParam, LPAR
 			{
 			case MENU1_ID:
 				DEBUG("menu item #1 triggered");
+				RECORD_EVENT(EVENT_COMMAND, 1U, 0U, 0U);
 				about_screen(FALSE);
 				break;
 			case MENU2_ID:
 				DEBUG("menu item #2 triggered");
-				if(clear_clipboard(TRUE))
-				{
-					g_tickCount = GetTickCount64();
-					PLAY_SOUND(1U);
-				}
+				RECORD_EVENT(EVENT_COMMAND, 2U, 0U, 0U);
+				request_clear(hWnd, TRUE, 1U);
 				break;
 			case MENU3_ID:
 				DEBUG("menu item #3 triggered");
-				cfg_halted = !cfg_halted;
-				CheckMenuItem(g_context_menu, MENU3_ID, cfg_halted ? MF_CHECKED : MF_UNCHECKED);
-				if(!update_shell_notify_icon(hWnd, cfg_halted))
-				{
-					DEBUG("failed to modify the shell notification icon!");
-				}
-				g_tickCount = GetTickCount64();
+				set_halted(hWnd, !cfg_halted);
 				break;
 			case MENU4_ID:
 				DEBUG("menu item #4 triggered");
+				RECORD_EVENT(EVENT_COMMAND, 4U, 0U, 0U);
 				PostMessageW(hWnd, WM_CLOSE, 0, 0);
 				break;
 			}
@@ -649,13 +1091,32 @@ static LRESULT CALLBACK my_wnd_proc(HWND hWnd, UINT message, WPARAM wParam, LPAR
 		if(wParam == ID_HOTKEY)
 		{
 			DEBUG("hotkey has been triggered.");
-			if(clear_clipboard(TRUE))
-			{
-				g_tickCount = GetTickCount64();
-				PLAY_SOUND(1U);
-			}
+			RECORD_EVENT(EVENT_HOTKEY, 0U, 0U, 0U);
+			request_clear(hWnd, TRUE, 1U);
+		}
+		break;
+	case WM_WTSSESSION_CHANGE:
+		TRACE("WM_WTSSESSION_CHANGE");
+		if(wParam == WTS_SESSION_LOCK)
+		{
+			session_changed(hWnd, SESSION_LOCK);
+		}
+		else if(wParam == WTS_SESSION_UNLOCK)
+		{
+			session_changed(hWnd, SESSION_UNLOCK);
 		}
 		break;
+	case WM_POWERBROADCAST:
+		TRACE("WM_POWERBROADCAST");
+		if(wParam == PBT_APMSUSPEND)
+		{
+			session_changed(hWnd, SESSION_SUSPEND);
+		}
+		else if((wParam == PBT_APMRESUMEAUTOMATIC) || (wParam == PBT_APMRESUMESUSPEND))
+		{
+			session_changed(hWnd, SESSION_RESUME);
+		}
+		return TRUE;
 	case WM_CLOSE:
 		PostQuitMessage(0);
 		break;
@@ -681,974 +1142,3256 @@ static LRESULT CALLBACK my_wnd_proc(HWND hWnd, UINT message, WPARAM wParam, LPAR
 }
 
 // ==========================================================================
-// Clear Clipboard
+// Change detection
 // ==========================================================================
 
-static UINT clear_clipboard(const BOOL force)
+static void clipboard_updated(const HWND hwnd)
 {
-	int retry;
-	UINT success = 0U;
+	const DWORD sequence = GetClipboardSequenceNumber();
+	++g_update_stats.notifications;
 
-	DEBUG("clearing clipboard...");
+	if(sequence == g_sequence)
+	{
+		TRACE("sequence number unchanged --> ignored.");
+		return;
+	}
 
-	if(!cfg_ignore_warning)
+	if(sequence == g_own_sequence)
 	{
-		recheck_clipboard_history();
+		TRACE("clipboard was cleared by ourselves --> ignored.");
+		RECORD_EVENT(EVENT_SELF_UPDATE, 0U, sequence, 0U);
+		g_sequence = sequence;
+		g_fingerprint = 0U;
+		++g_update_stats.self_updates;
+		update_timer(hwnd);
+		return;
 	}
 
-	for(retry = 0; retry < 32; ++retry)
+	if(!g_update.pending)
 	{
-		if(retry > 0)
-		{
-			TRACE("retry!");
-			Sleep(1); /*yield*/
-		}
-		if(OpenClipboard(NULL))
-		{
-			if(force || is_textual_format())
-			{
-				if(EmptyClipboard())
-				{
-					success = 1U; /*cleared*/
-				}
-			}
-			else
-			{
-				success = 2U; /*skipped*/
-			}
-			CloseClipboard();
-		}
-		if(success)
+		if(!scheduler_set(hwnd, SLOT_UPDATE, UPDATE_DELAY))
 		{
-			break; /*completed*/
+			DEBUG("failed to set up the update timer!");
+			g_update.start = GetTickCount64();
+			g_update.burst = 1U;
+			process_update(hwnd);
+			return;
 		}
+		g_update.pending = TRUE;
+		g_update.start = GetTickCount64();
+		g_update.burst = 0U;
+	}
+
+	++g_update.burst;
+}
+
+static void process_update(const HWND hwnd)
+{
+	const DWORD sequence = GetClipboardSequenceNumber();
+
+	if(g_update.pending)
+	{
+		scheduler_cancel(hwnd, SLOT_UPDATE);
+		g_update.pending = FALSE;
 	}
 
-	if(success)
+	if((sequence != g_sequence) && (sequence != g_own_sequence))
 	{
-		if(success > 1U)
+		const DWORD fingerprint = cfg_ignore_recopy ? get_item_fingerprint() : 0U;
+		g_sequence = sequence;
+		if(fingerprint && (fingerprint == g_fingerprint))
 		{
-			DEBUG("format is not text --> skipped!");
+			DEBUG("identical content was copied again --> deadline kept.");
+			++g_update_stats.recopies;
 		}
 		else
 		{
-			DEBUG("cleared.");
+			DEBUG("clipboard content has changed.");
+			g_fingerprint = fingerprint;
+			g_tickCount = g_update.start;
+			g_item_timeout = get_item_timeout();
+			g_skip_current = FALSE;
+			++g_update_stats.items;
+			RECORD_EVENT(EVENT_UPDATE, g_update.burst, sequence, g_item_timeout);
+			if(cfg_trace_file)
+			{
+				trace_item();
+			}
+			DEBUG2("update stats: burst=%u, items=%u", g_update.burst, g_update_stats.items);
+			DEBUG2("update stats: notifications=%u, self=%u, ratio=%u%%", g_update_stats.notifications, g_update_stats.self_updates, (100U * g_update_stats.notifications) / g_update_stats.items);
 		}
 	}
 	else
 	{
-		DEBUG("failed to clear clipboard!");
+		g_sequence = sequence;
 	}
 
-	return success;
-}
-
-static BOOL is_textual_format(void)
-{
-	const INT result = GetPriorityClipboardFormat(g_text_formats, _countof(g_text_formats));
-	TRACE2("clipboard_format=%d", result);
-	return (result > 0);
+	update_timer(hwnd);
 }
 
 // ==========================================================================
-// Check clipboard history service
+// Timer routines
 // ==========================================================================
 
-static BOOL check_clipboard_history(void)
+/*
+ * The clear deadline, the clear retry and the update coalescing delay are slots of one scheduler,
+ * which is backed by a single window timer that is always set to the earliest due slot. Thus,
+ * there is never more than one pending timer, regardless of how many slots are active.
+ */
+
+static BOOL _scheduler_rearm(const HWND hwnd)
 {
-	if(!is_windows_version_or_greater(HIBYTE(WIN32_WINNT_WINTHRESHOLD), LOBYTE(WIN32_WINNT_WINTHRESHOLD), 0))
+	ULONGLONG earliest = MAXULONGLONG, now;
+	UINT slot;
+
+	if(g_scheduler.dispatching)
 	{
-		TRACE("not running on Windows 10 or later.");
-		return TRUE;
+		return TRUE; /*re-armed after dispatching*/
 	}
 
-	if(find_running_service(L"cbdhsvc"))
+	for(slot = 0U; slot < SLOT_COUNT; ++slot)
 	{
-		DEBUG("windows clipboard history service is running!");
-		if(MESSAGE_BOX(L"The \"Clipboard History\" service of Windows 10 is currently running on your machine. As long as that service is running, Windows 10 will silently keep a history (copy) of *all* data that has been copied to the clipboard at some time.\n\nIn order to keep your sensitive data private, it is *highly* recommended to disable the \"Clipboard History\" service! Do you want to disable the \"Clipboard History\" service now?", MB_ICONWARNING | MB_YESNO) == IDYES)
+		if((g_scheduler.active & (1U << slot)) && (g_scheduler.due[slot] < earliest))
 		{
-			WCHAR *sys_path = get_system_directory();
-			if(sys_path)
-			{
-				WCHAR *reg_path = concat_strings(sys_path, L"\\reg.exe");
-				if(reg_path)
-				{
-					BOOL success = FALSE;
-					while(!success)
-					{
-						DEBUG("trying to disable clipboard history service...");
-						if(success = (((INT_PTR)ShellExecuteW(NULL, L"runas", reg_path, L"ADD HKLM\\SYSTEM\\CurrentControlSet\\Services\\cbdhsvc /f /v Start /t REG_DWORD /d 4", NULL, SW_HIDE)) > 32))
-						{
-							DEBUG("clipboard history service disable.");
-							MESSAGE_BOX(L"The \"Clipboard History\" service has been disabled. Please reboot your computer for these changes to take effect!", MB_ICONINFORMATION);
-						}
-						else
-						{
-							DEBUG("failed to disable clipboard history service!");
-							if(MESSAGE_BOX(L"Failed to disable the service. Retry?", MB_ICONERROR | MB_YESNO) == IDNO)
-							{
-								break; /*aborted*/
-							}
-						}
-					}
-					FREE(reg_path);
-				}
-				FREE(sys_path);
-			}
-			DEBUG("reboot is required --> exiting!");
-			MESSAGE_BOX(L"The ClearClipboard program is going to exit for now!", MB_ICONWARNING);
+			earliest = g_scheduler.due[slot];
 		}
-		else
+	}
+
+	if(!g_scheduler.active)
+	{
+		if(g_scheduler.armed)
 		{
-			DEBUG("clipboard history service is still running --> exiting!");
-			MESSAGE_BOX(L"The ClearClipboard program is going to exit now!\n\nNote: If you want to use ClearClipboard despite the fact that the \"Clipboard History\" service is still running on your machine, pelease refer to the documentation (README file).", MB_ICONWARNING);
+			KillTimer(hwnd, TIMER_ID);
+			g_scheduler.armed = FALSE;
 		}
+		return TRUE;
+	}
+
+	if(g_scheduler.armed && (g_scheduler.armed_due == earliest))
+	{
+		return TRUE; /*unchanged*/
+	}
+
+	now = GetTickCount64();
+	if(!SetTimer(hwnd, TIMER_ID, (earliest > now) ? max((UINT)(earliest - now), USER_TIMER_MINIMUM) : USER_TIMER_MINIMUM, NULL))
+	{
+		DEBUG("failed to set up the window timer!");
+		g_scheduler.armed = FALSE;
 		return FALSE;
 	}
 
+	g_scheduler.armed_due = earliest;
+	g_scheduler.armed = TRUE;
 	return TRUE;
 }
 
-static BOOL recheck_clipboard_history(void)
+static BOOL scheduler_set(const HWND hwnd, const UINT slot, const UINT delay)
 {
-	HWND hwnd;
+	g_scheduler.due[slot] = GetTickCount64() + delay;
+	g_scheduler.active |= 1U << slot;
 
-	if(is_windows_version_or_greater(HIBYTE(WIN32_WINNT_WINTHRESHOLD), LOBYTE(WIN32_WINNT_WINTHRESHOLD), 0))
+	if(!_scheduler_rearm(hwnd))
 	{
-		if(find_running_service(L"cbdhsvc"))
-		{
-			DEBUG("windows clipboard history service is running!");
-			MESSAGE_BOX_ASYNC(L"A problem has been detected:\n\nThe \"Clipboard History\" service of Windows 10 is currently running on your machine. As long as that service is running, Windows 10 will silently keep a history (copy) of *all* data that has been copied to the clipboard at some time.\n\nPlease refer to the documentation (README) for details!", MB_ICONWARNING);
-			return FALSE;
-		}
-	}
-
-	if(hwnd = FindWindow(NULL, L"Ditto Clipboard Viewer"))
-	{
-		WCHAR class_name[5];
-		if(GetClassNameW(hwnd, class_name, 5) && (!lstrcmpiW(class_name, L"Afx:")))
-		{
-			DEBUG("ditto clipboard manager process is running!");
-			MESSAGE_BOX_ASYNC(L"A problem has been detected:\n\nThe \"Ditto\" clipboard manager is currently running on your machine. That program keeps a history (copy) of *all* data that has been copied to the clipboard at some time.\n\nPlease terminate \"Ditto\" while ClearClipboard is running!", MB_ICONWARNING);
-			return FALSE;
-		}
+		g_scheduler.active &= ~(1U << slot);
+		return FALSE;
 	}
 
 	return TRUE;
 }
 
-// ==========================================================================
-// Process CLI arguments
-// ==========================================================================
+static void scheduler_cancel(const HWND hwnd, const UINT slot)
+{
+	if(g_scheduler.active & (1U << slot))
+	{
+		g_scheduler.active &= ~(1U << slot);
+		_scheduler_rearm(hwnd);
+	}
+}
 
-static UINT parse_arguments(const WCHAR *const command_line)
+static void scheduler_dispatch(const HWND hwnd)
 {
-	const WCHAR **argv;
-	int i, argc;
-	UINT mode = 0U;
+	const ULONGLONG now = GetTickCount64();
+	UINT slot;
 
-	argv = CommandLineToArgvW(command_line, &argc);
-	if(argv)
+	KillTimer(hwnd, TIMER_ID);
+	g_scheduler.armed = FALSE;
+	g_scheduler.dispatching = TRUE;
+
+	for(slot = 0U; slot < SLOT_COUNT; ++slot)
 	{
-		for(i = 1; i < argc; ++i)
+		if((g_scheduler.active & (1U << slot)) && (g_scheduler.due[slot] <= now))
 		{
-			const WCHAR *value = argv[i];
-			while((*value) && (*value <= 0x20))
-			{
-				++value;
-			}
-			if(*value)
+			g_scheduler.active &= ~(1U << slot);
+			switch(slot)
 			{
-				if(!lstrcmpiW(value, L"--close"))
-				{
-					mode = 1U;
-				}
-				else if(!lstrcmpiW(value, L"--restart"))
-				{
-					mode = 2U;
-				}
-				else if(!lstrcmpiW(value, L"--install"))
-				{
-					mode = 3U;
-				}
-				else if(!lstrcmpiW(value, L"--uninstall"))
-				{
-					mode = 4U;
-				}
-#ifndef _DEBUG
-				else if(!lstrcmpiW(value, L"--debug"))
-				{
-					cfg_debug = max(cfg_debug, 1U);
-				}
-				else if(!lstrcmpiW(value, L"--trace"))
-				{
-					cfg_debug = max(cfg_debug, 2U);
-				}
-#endif //_DEBUG
-				else if(!lstrcmpiW(value, L"--silent"))
-				{
-					cfg_silent = TRUE;
-				}
-				else if(!lstrcmpiW(value, L"--slunk"))
-				{
-					ShellExecuteW(NULL, NULL, L"https://youtu.be/n4bply6Ibqw", NULL, NULL, SW_SHOW);
-				}
-				else
-				{
-					mode = MAXUINT;
-					break; /*bad argument*/
-				}
+			case SLOT_UPDATE:
+				process_update(hwnd);
+				break;
+			case SLOT_RETRY:
+				process_clear(hwnd);
+				break;
+			case SLOT_DEADLINE:
+				process_deadline(hwnd);
+				break;
 			}
 		}
-		FREE(argv);
 	}
 
-	return mode;
+	g_scheduler.dispatching = FALSE;
+	_scheduler_rearm(hwnd);
 }
 
-// ==========================================================================
-// Autorun support
-// ==========================================================================
-
-static BOOL update_autorun_entry(const BOOL remove)
+static BOOL update_timer(const HWND hwnd)
 {
-	static const WCHAR *const REG_VALUE_NAME = L"com.muldersoft.clear_clipboard";
-	static const WCHAR *const REG_VALUE_PATH = L"Software\\Microsoft\\Windows\\CurrentVersion\\Run";
-
-	BOOL success = FALSE;
+	UINT delay;
 
-	if(!remove)
+	if(cfg_halted || g_skip_current || g_clear.pending || (!g_item_timeout) || (!get_item_classes()))
 	{
-		const WCHAR *executable_path = get_executable_path();
-		if(executable_path)
-		{
-			const WCHAR *command_str = quote_string(executable_path);
-			if(command_str)
-			{
-				DEBUG("adding autorun entry to registry...");
-				if(reg_write_string(HKEY_CURRENT_USER, REG_VALUE_PATH, REG_VALUE_NAME, command_str))
-				{
-					DEBUG("succeeded.");
-					success = TRUE;
-				}
-				else
-				{
-					DEBUG("failed to add autorun entry to registry!");
-				}
-				FREE(command_str);
-			}
-			else
-			{
-				DEBUG("failed to allocate string buffer!");
-			}
-			FREE(executable_path);
-		}
-		else
+		if(g_scheduler.active & (1U << SLOT_DEADLINE))
 		{
-			DEBUG("failed to determine executable path!");
+			TRACE("timer disarmed.");
+			scheduler_cancel(hwnd, SLOT_DEADLINE);
 		}
+		return TRUE; /*nothing to do*/
 	}
-	else
+
+	delay = schedule_delay(GetTickCount64(), g_tickCount, g_item_timeout);
+	if(!scheduler_set(hwnd, SLOT_DEADLINE, delay))
 	{
-		DEBUG("removing autorun entry from registry...");
-		if(reg_delete_value(HKEY_CURRENT_USER, REG_VALUE_PATH, REG_VALUE_NAME))
+		return FALSE;
+	}
+
+	TRACE2("timer armed: delay=%u", delay);
+	return TRUE;
+}
+
+static void process_deadline(const HWND hwnd)
+{
+	const ULONGLONG tickCount = GetTickCount64();
+
+	if(schedule_expired(tickCount, g_tickCount, g_item_timeout))
+	{
+		DEBUG("timer triggered!");
+		RECORD_EVENT(EVENT_TIMER, cfg_halted, (DWORD)(tickCount - g_tickCount) - g_item_timeout, g_item_timeout);
+		METRICS_HISTOGRAM(clear_lateness, (DWORD)(tickCount - g_tickCount) - g_item_timeout);
+		if(!cfg_halted)
 		{
-			DEBUG("succeeded.");
-			success = TRUE;
+			request_clear(hwnd, is_clear_forced(), 2U);
 		}
 		else
 		{
-			DEBUG("failed to remove autorun entry from registry!");
+			DEBUG("automatic clearing is halted.");
+			g_tickCount = tickCount;
 		}
 	}
 
-	return success;
+	update_timer(hwnd);
 }
 
-// ==========================================================================
-// Shell notification icon
-// ==========================================================================
+static void set_halted(const HWND hwnd, const BOOL halted)
+{
+	if((!cfg_halted) == (!halted))
+	{
+		return; /*unchanged*/
+	}
 
-#define INITIALIZE_TIP(X,Y) do \
-{ \
-	lstrcpyW((X), L"ClearClipboard v" WTEXT(VERSION_STR)); \
-	if((Y)) \
-		lstrcatW(shell_icon_data.szTip, L" - halted"); \
-} \
-while(0)
+	RECORD_EVENT(EVENT_COMMAND, 3U, 0U, 0U);
+	cfg_halted = halted;
+	CheckMenuItem(g_context_menu, MENU3_ID, cfg_halted ? MF_CHECKED : MF_UNCHECKED);
+	if(!update_shell_notify_icon(hwnd, cfg_halted))
+	{
+		DEBUG("failed to modify the shell notification icon!");
+	}
 
-static BOOL create_shell_notify_icon(const HWND hwnd, const BOOL halted)
+	g_tickCount = GetTickCount64();
+	update_timer(hwnd);
+}
+
+/*
+ * Locking the session and suspending the machine are inputs to the scheduler, too. GetTickCount64()
+ * keeps counting while the machine is suspended (unlike the "unbiased" interrupt time), so a deadline
+ * that passed during the suspend is already expired on resume, and gets handled right away, instead
+ * of waiting for the window timer to catch up.
+ */
+
+static void session_changed(const HWND hwnd, const UINT event)
 {
-	NOTIFYICONDATAW shell_icon_data;
-	SecureZeroMemory(&shell_icon_data, sizeof(NOTIFYICONDATAW));
+	const BOOL clear = (!cfg_halted) && (((event == SESSION_LOCK) && cfg_clear_on_lock) || ((event == SESSION_SUSPEND) && cfg_clear_on_suspend));
 
-	shell_icon_data.cbSize = sizeof(NOTIFYICONDATAW);
-	shell_icon_data.hWnd = hwnd;
-	shell_icon_data.uID = ID_NOTIFYICON;
-	shell_icon_data.uCallbackMessage = WM_NOTIFYICON;
-	INITIALIZE_TIP(shell_icon_data.szTip, halted);
-	shell_icon_data.uFlags = NIF_TIP | NIF_SHOWTIP | NIF_MESSAGE;
-	if(g_app_icon[halted ? 1U : 0U])
+	DEBUG2("session event: event=%u, clear=%s", event, BOOLIFY(clear));
+	RECORD_EVENT(EVENT_SESSION, event, clear, 0U);
+
+	if(clear)
 	{
-		shell_icon_data.hIcon = g_app_icon[halted ? 1U : 0U];
-		shell_icon_data.uFlags |= NIF_ICON;
+		if(get_item_classes())
+		{
+			request_clear(hwnd, is_clear_forced(), 2U);
+		}
+	}
+	else if((event == SESSION_UNLOCK) || (event == SESSION_RESUME))
+	{
+		if(g_scheduler.active & (1U << SLOT_DEADLINE))
+		{
+			process_deadline(hwnd);
+		}
 	}
+}
 
-	if(Shell_NotifyIconW(NIM_ADD, &shell_icon_data))
+// ==========================================================================
+// Clear Clipboard
+// ==========================================================================
+
+static void request_clear(const HWND hwnd, const BOOL force, const UINT sound_level)
+{
+	if(g_clear.pending)
 	{
-		shell_icon_data.uVersion = NOTIFYICON_VERSION_4;
-		Shell_NotifyIconW(NIM_SETVERSION, &shell_icon_data);
+		TRACE("clearing is already pending.");
+		g_clear.force = g_clear.force || force;
+		g_clear.sound_level = min(g_clear.sound_level, sound_level); /*lower level wins: the sound plays if "Sound" >= level, so a merged manual clear (1) stays audible at Sound=1*/
+		return;
 	}
-	else
+
+	DEBUG("clearing clipboard...");
+
+	if(!cfg_ignore_warning)
 	{
-		return FALSE;
+		recheck_clipboard_history();
 	}
 
-	return TRUE;
+	g_clear.force = force;
+	g_clear.sound_level = sound_level;
+	g_clear.retries = 0U;
+	g_clear.delay = USER_TIMER_MINIMUM;
+	g_clear.start = GetTickCount64();
+
+	process_clear(hwnd);
 }
 
-static BOOL update_shell_notify_icon(const HWND hwnd, const BOOL halted)
+static void process_clear(const HWND hwnd)
 {
-	NOTIFYICONDATAW shell_icon_data;
-	SecureZeroMemory(&shell_icon_data, sizeof(NOTIFYICONDATAW));
+	const UINT result = clear_clipboard(g_clear.force);
+	const ULONGLONG tickCount = GetTickCount64();
+	const UINT elapsed = (tickCount > g_clear.start) ? (UINT)(tickCount - g_clear.start) : 0U;
 
-	shell_icon_data.cbSize = sizeof(NOTIFYICONDATAW);
-	shell_icon_data.hWnd = hwnd;
-	shell_icon_data.uID = ID_NOTIFYICON;
-	INITIALIZE_TIP(shell_icon_data.szTip, halted);
-	shell_icon_data.uFlags = NIF_TIP | NIF_SHOWTIP;
-	if(g_app_icon[halted ? 1U : 0U])
+	if((!result) && (elapsed < cfg_retry_timeout))
 	{
-		shell_icon_data.hIcon = g_app_icon[halted ? 1U : 0U];
-		shell_icon_data.uFlags |= NIF_ICON;
+		TRACE2("clipboard is busy, retry in %u msec.", g_clear.delay);
+		if(scheduler_set(hwnd, SLOT_RETRY, g_clear.delay))
+		{
+			RECORD_EVENT(EVENT_RETRY, g_clear.retries + 1U, g_clear.delay, elapsed);
+			g_clear.pending = TRUE;
+			g_clear.delay = min(2U * g_clear.delay, RETRY_MAX_DELAY);
+			++g_clear.retries;
+			return;
+		}
+		DEBUG("failed to set up the retry timer!");
 	}
 
-	if(!Shell_NotifyIconW(NIM_MODIFY, &shell_icon_data))
+	if(g_clear.pending)
 	{
-		return FALSE;
+		scheduler_cancel(hwnd, SLOT_RETRY);
+		g_clear.pending = FALSE;
 	}
 
-	return TRUE;
+	DEBUG2("clear completed: result=%u, retries=%u, contention=%u", result, g_clear.retries, elapsed);
+	RECORD_EVENT(EVENT_CLEAR, result, g_clear.retries, elapsed);
+	METRICS_COUNTER(clears[min(result, 2U)], 1L);
+	METRICS_COUNTER(retries, (LONG)g_clear.retries);
+	METRICS_HISTOGRAM(open_contention, elapsed);
+
+	switch(result)
+	{
+	case 1U:
+		DEBUG("cleared.");
+		g_tickCount = tickCount;
+		PLAY_SOUND(g_clear.sound_level);
+		break;
+	case 2U:
+		DEBUG("format is not text --> skipped!");
+		g_tickCount = tickCount;
+		g_skip_current = TRUE; /*wait for next update*/
+		break;
+	default:
+		DEBUG("failed to clear clipboard!");
+	}
+
+	update_timer(hwnd);
 }
 
-static BOOL delete_shell_notify_icon(const HWND hwnd)
+static UINT clear_clipboard(const BOOL force)
 {
-	NOTIFYICONDATAW shell_icon_data;
-	SecureZeroMemory(&shell_icon_data, sizeof(NOTIFYICONDATAW));
+	UINT success = 0U;
 
-	shell_icon_data.cbSize = sizeof(NOTIFYICONDATAW);
-	shell_icon_data.hWnd = hwnd;
-	shell_icon_data.uID = ID_NOTIFYICON;
-	
-	if(!Shell_NotifyIconW(NIM_DELETE, &shell_icon_data))
+	if(OpenClipboard(NULL))
 	{
-		return FALSE;
+		if(force || is_textual_format())
+		{
+			if(EmptyClipboard())
+			{
+				g_own_sequence = GetClipboardSequenceNumber();
+				success = 1U; /*cleared*/
+			}
+		}
+		else
+		{
+			success = 2U; /*skipped*/
+		}
+		CloseClipboard();
 	}
 
-	return TRUE;
+	return success;
+}
+
+static BOOL is_textual_format(void)
+{
+	update_inventory(TRUE);
+	TRACE2("clipboard_classes=0x%02X", g_inventory.classes);
+	return !!(g_inventory.classes & ((1U << FORMAT_CLASS_TEXT) | (1U << FORMAT_CLASS_RICH)));
 }
 
 // ==========================================================================
-// About dialog
+// Format policy
 // ==========================================================================
 
-#define ABOUT_TEXT_SHRT \
-	L"ClearClipboard v" WTEXT(VERSION_STR) L" [" WTEXT(__DATE__) L"]\n" \
-	L"Copyright(\x24B8) 2019 LoRd_MuldeR <mulder2@gmx.de>\n\n" \
-	L"This software is released under the MIT License.\n" \
-	L"(https://opensource.org/licenses/MIT)\n\n" \
-	L"For news and updates please check the website at:\n" \
-	L"\x2022 http://muldersoft.com/\n" \
-	L"\x2022 http://muldersoft.sourceforge.net/\n\n" \
-	L"Source code available from:\n" \
-	L"https://github.com/lordmulder/ClearClipboard"
+static void load_settings(const config_t *const config, settings_t *const settings)
+{
+	UINT i;
 
-#define ABOUT_TEXT_FULL \
-	ABOUT_TEXT_SHRT \
-	L"\n\n\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\n\n" \
-	L"DISCLAIMER: " \
-	L"The software is provided \"as is\", without warranty of any kind, express or implied, including" \
-	L"but not limited to the warranties of merchantability, fitness for a particular purpose and" \
-	L"noninfringement. In no event shall the authors or copyright holders be liable for any claim," \
-	L"damages or other liability, whether in an action of contract, tort or otherwise, arising from," \
-	L"out of or in connection with the software or the use or other dealings in the software.\n\n" \
-	L"If you agree to the license terms, click OK in order to proceed. Otherwise you must click Cancel and exit the program."
+	settings->timeout = (UINT) get_config_value(config, L"Timeout", DEFAULT_TIMEOUT, 1000, 3600000/*1h*/);
+	settings->textual_only = !!get_config_value(config, L"TextOnly", FALSE, FALSE, TRUE);
+	settings->sound_enabled = (UINT) get_config_value(config, L"Sound", DEFAULT_SOUND_LEVEL, 0, 2);
+	settings->retry_timeout = (UINT) get_config_value(config, L"RetryTimeout", DEFAULT_RETRY_TIMEOUT, 0, 60000);
 
-static BOOL about_screen(const BOOL first_run)
+	settings->class_timeout[FORMAT_CLASS_NONE] = 0U;
+	for(i = FORMAT_CLASS_TEXT; i < FORMAT_CLASS_COUNT; ++i)
+	{
+		settings->class_timeout[i] = (settings->textual_only && (i > FORMAT_CLASS_RICH)) ? 0U : settings->timeout;
+	}
+
+	settings->class_timeout[FORMAT_CLASS_TEXT]  = get_config_timeout(config, L"TimeoutText",     settings->class_timeout[FORMAT_CLASS_TEXT]);
+	settings->class_timeout[FORMAT_CLASS_RICH]  = get_config_timeout(config, L"TimeoutRichText", settings->class_timeout[FORMAT_CLASS_RICH]);
+	settings->class_timeout[FORMAT_CLASS_IMAGE] = get_config_timeout(config, L"TimeoutImage",    settings->class_timeout[FORMAT_CLASS_IMAGE]);
+	settings->class_timeout[FORMAT_CLASS_FILES] = get_config_timeout(config, L"TimeoutFiles",    settings->class_timeout[FORMAT_CLASS_FILES]);
+	settings->class_timeout[FORMAT_CLASS_OTHER] = get_config_timeout(config, L"TimeoutOther",    settings->class_timeout[FORMAT_CLASS_OTHER]);
+	settings->sensitive_timeout = get_config_timeout(config, L"TimeoutSensitive", 0U);
+}
+
+static void apply_settings(const settings_t *const settings)
+{
+	UINT i;
+
+	cfg_timeout = settings->timeout;
+	cfg_textual_only = settings->textual_only;
+	cfg_sound_enabled = settings->sound_enabled;
+	cfg_retry_timeout = settings->retry_timeout;
+	cfg_sensitive_timeout = settings->sensitive_timeout;
+	for(i = FORMAT_CLASS_TEXT; i < FORMAT_CLASS_COUNT; ++i)
+	{
+		cfg_class_timeout[i] = settings->class_timeout[i];
+	}
+
+	g_uniform_policy = TRUE;
+	for(i = FORMAT_CLASS_TEXT + 1U; i < FORMAT_CLASS_COUNT; ++i)
+	{
+		if(cfg_class_timeout[i] != cfg_class_timeout[FORMAT_CLASS_TEXT])
+		{
+			g_uniform_policy = FALSE;
+			break;
+		}
+	}
+}
+
+static UINT get_format_class(const UINT format)
+{
+	UINT slot;
+
+	switch(format)
+	{
+	case CF_TEXT:
+	case CF_OEMTEXT:
+	case CF_UNICODETEXT:
+	case CF_DSPTEXT:
+		return FORMAT_CLASS_TEXT;
+	case CF_BITMAP:
+	case CF_METAFILEPICT:
+	case CF_TIFF:
+	case CF_DIB:
+	case CF_ENHMETAFILE:
+	case CF_DIBV5:
+	case CF_DSPBITMAP:
+	case CF_DSPMETAFILEPICT:
+	case CF_DSPENHMETAFILE:
+		return FORMAT_CLASS_IMAGE;
+	case CF_HDROP:
+		return FORMAT_CLASS_FILES;
+	case CF_LOCALE:
+	case CF_PALETTE:
+		return FORMAT_CLASS_NONE;
+	}
+
+	for(slot = format & (FORMAT_TABLE_SIZE - 1U); g_format_table[slot].format; slot = (slot + 1U) & (FORMAT_TABLE_SIZE - 1U))
+	{
+		if(g_format_table[slot].format == format)
+		{
+			return g_format_table[slot].format_class;
+		}
+	}
+
+	return FORMAT_CLASS_OTHER;
+}
+
+/*
+ * The format inventory of the current clipboard item is enumerated only once per clipboard sequence
+ * number, and kept as a bit set of format classes, which is then shared by all policy decisions, the
+ * "TextOnly" check, the sensitive content scan and the trace. The caller must pass is_open = TRUE, if
+ * the clipboard is already open, because nested OpenClipboard()/CloseClipboard() calls don't stack.
+ */
+
+static void update_inventory(const BOOL is_open)
+{
+	UINT format = 0U;
+	DWORD sequence = GetClipboardSequenceNumber();
+
+	if(sequence && (sequence == g_inventory.sequence))
+	{
+		++g_inventory.saved;
+		return; /*still up-to-date*/
+	}
+
+	if(!(is_open || OpenClipboard(NULL)))
+	{
+		TRACE("failed to open clipboard, assuming all formats!");
+		g_inventory.sequence = 0U;
+		g_inventory.classes = (CountClipboardFormats() > 0) ? MAXUINT : 0U;
+		g_inventory.unicode_text = TRUE;
+		g_inventory.formats = 0U;
+		return;
+	}
+
+	++g_inventory.queries;
+	g_inventory.sequence = sequence = GetClipboardSequenceNumber();
+	g_inventory.classes = 0U;
+	g_inventory.unicode_text = FALSE;
+	g_inventory.formats = 0U;
+	while(format = EnumClipboardFormats(format))
+	{
+		g_inventory.classes |= 1U << get_format_class(format);
+		g_inventory.formats = ROTL32(g_inventory.formats ^ format, 5U) * HASH_PRIME32_1; /*hash of the format list, see get_item_fingerprint()*/
+		if(format == CF_UNICODETEXT)
+		{
+			g_inventory.unicode_text = TRUE;
+		}
+	}
+
+	if(!is_open)
+	{
+		CloseClipboard();
+	}
+
+	TRACE2("inventory: sequence=%u, classes=0x%02X", sequence, g_inventory.classes);
+}
+
+static UINT get_item_classes(void)
+{
+	update_inventory(FALSE);
+	return g_inventory.classes;
+}
+
+static UINT get_item_timeout(void)
+{
+	UINT i, timeout = 0U, classes = 0U;
+
+	if(g_uniform_policy)
+	{
+		timeout = cfg_class_timeout[FORMAT_CLASS_TEXT];
+	}
+	else
+	{
+		classes = get_item_classes();
+	}
+
+	for(i = FORMAT_CLASS_TEXT; i < FORMAT_CLASS_COUNT; ++i)
+	{
+		if((classes & (1U << i)) && cfg_class_timeout[i] && ((!timeout) || (cfg_class_timeout[i] < timeout)))
+		{
+			timeout = cfg_class_timeout[i];
+		}
+	}
+
+	if(cfg_sensitive_timeout && ((!timeout) || (cfg_sensitive_timeout < timeout)))
+	{
+		if(contains_sensitive_text())
+		{
+			DEBUG("sensitive content detected!");
+			timeout = cfg_sensitive_timeout;
+		}
+	}
+
+	TRACE2("item_timeout=%u", timeout);
+	return timeout;
+}
+
+static BOOL is_clear_forced(void)
+{
+	UINT i, classes;
+
+	if(!cfg_textual_only)
+	{
+		return TRUE;
+	}
+
+	/*with TextOnly, non-textual classes default to 0, so a non-zero timeout was set explicitly and takes precedence*/
+	classes = get_item_classes();
+	for(i = FORMAT_CLASS_RICH + 1U; i < FORMAT_CLASS_COUNT; ++i)
+	{
+		if((classes & (1U << i)) && cfg_class_timeout[i])
+		{
+			return TRUE;
+		}
+	}
+
+	return FALSE;
+}
+
+// ==========================================================================
+// Sensitive content detection
+// ==========================================================================
+
+static BOOL contains_sensitive_text(void)
+{
+	UINT result = SCAN_NONE;
+
+	update_inventory(FALSE);
+	if(!g_inventory.unicode_text)
+	{
+		return FALSE; /*no text*/
+	}
+
+	if(OpenClipboard(NULL))
+	{
+		const HANDLE data = GetClipboardData(CF_UNICODETEXT);
+		if(data)
+		{
+			const WCHAR *const text = (const WCHAR*) GlobalLock(data);
+			if(text)
+			{
+				result = scan_sensitive_text(text, min(GlobalSize(data) / sizeof(WCHAR), SCAN_LIMIT), g_have_sse2);
+				GlobalUnlock(data);
+			}
+		}
+		CloseClipboard();
+	}
+	else
+	{
+		TRACE("failed to open clipboard for scanning!");
+	}
+
+	if(result != SCAN_NONE)
+	{
+		TRACE2("%s detected.", SCAN_RESULT_NAMES[result]);
+		return TRUE;
+	}
+
+	return FALSE;
+}
+
+// ==========================================================================
+// Content fingerprint
+// ==========================================================================
+
+/*
+ * With "IgnoreRecopy" enabled, each new clipboard item is fingerprinted, so that applications which
+ * re-publish the very same data do not keep postponing the deadline. The fingerprint covers the list of
+ * available formats and, if present, the Unicode text, which is hashed in place (no copy is made), using
+ * xxHash32. Other formats are never requested, because that would force the owner to render data that
+ * is delayed-rendered; hence items without text are told apart by their format list only. Only the first
+ * FINGERPRINT_LIMIT bytes of the text are hashed, plus the total size. Either limit can only make a new
+ * item look like a re-copy, which keeps the earlier deadline, so the data is never kept for longer.
+ */
+
+static DWORD get_item_fingerprint(void)
+{
+	DWORD fingerprint;
+
+	if(!OpenClipboard(NULL))
+	{
+		TRACE("failed to open clipboard for fingerprinting!");
+		return 0U;
+	}
+
+	update_inventory(TRUE);
+	fingerprint = g_inventory.formats;
+	if(g_inventory.unicode_text)
+	{
+		const HANDLE data = GetClipboardData(CF_UNICODETEXT);
+		if(data)
+		{
+			const BYTE *const ptr = (const BYTE*) GlobalLock(data);
+			if(ptr)
+			{
+				const SIZE_T size = GlobalSize(data);
+				fingerprint ^= hash_xxh32(ptr, min(size, FINGERPRINT_LIMIT)) + (DWORD)size;
+				GlobalUnlock(data);
+			}
+		}
+	}
+
+	CloseClipboard();
+	TRACE2("fingerprint: text=%u, hash=0x%08X", g_inventory.unicode_text, fingerprint);
+	return fingerprint ? fingerprint : 1U;
+}
+
+// ==========================================================================
+// Check clipboard history service
+// ==========================================================================
+
+static BOOL check_clipboard_history(void)
+{
+	if(!is_windows_version_or_greater(HIBYTE(WIN32_WINNT_WINTHRESHOLD), LOBYTE(WIN32_WINNT_WINTHRESHOLD), 0))
+	{
+		TRACE("not running on Windows 10 or later.");
+		return TRUE;
+	}
+
+	if(find_running_service(L"cbdhsvc"))
+	{
+		DEBUG("windows clipboard history service is running!");
+		if(MESSAGE_BOX(L"The \"Clipboard History\" service of Windows 10 is currently running on your machine. As long as that service is running, Windows 10 will silently keep a history (copy) of *all* data that has been copied to the clipboard at some time.\n\nIn order to keep your sensitive data private, it is *highly* recommended to disable the \"Clipboard History\" service! Do you want to disable the \"Clipboard History\" service now?", MB_ICONWARNING | MB_YESNO) == IDYES)
+		{
+			WCHAR *sys_path = get_system_directory();
+			if(sys_path)
+			{
+				WCHAR *reg_path = concat_strings(sys_path, L"\\reg.exe");
+				if(reg_path)
+				{
+					BOOL success = FALSE;
+					while(!success)
+					{
+						DEBUG("trying to disable clipboard history service...");
+						if(success = (((INT_PTR)ShellExecuteW(NULL, L"runas", reg_path, L"ADD HKLM\\SYSTEM\\CurrentControlSet\\Services\\cbdhsvc /f /v Start /t REG_DWORD /d 4", NULL, SW_HIDE)) > 32))
+						{
+							DEBUG("clipboard history service disable.");
+							MESSAGE_BOX(L"The \"Clipboard History\" service has been disabled. Please reboot your computer for these changes to take effect!", MB_ICONINFORMATION);
+						}
+						else
+						{
+							DEBUG("failed to disable clipboard history service!");
+							if(MESSAGE_BOX(L"Failed to disable the service. Retry?", MB_ICONERROR | MB_YESNO) == IDNO)
+							{
+								break; /*aborted*/
+							}
+						}
+					}
+					FREE(reg_path);
+				}
+				FREE(sys_path);
+			}
+			DEBUG("reboot is required --> exiting!");
+			MESSAGE_BOX(L"The ClearClipboard program is going to exit for now!", MB_ICONWARNING);
+		}
+		else
+		{
+			DEBUG("clipboard history service is still running --> exiting!");
+			MESSAGE_BOX(L"The ClearClipboard program is going to exit now!\n\nNote: If you want to use ClearClipboard despite the fact that the \"Clipboard History\" service is still running on your machine, pelease refer to the documentation (README file).", MB_ICONWARNING);
+		}
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/*
+ * Enumerating the active services is slow, so the risk detector thread re-checks in the background,
+ * at a slow interval and after each clear, and publishes its verdict as a bit mask. Clearing the
+ * clipboard only reads the cached verdict.
+ */
+
+static HANDLE g_risk_thread = NULL, g_risk_stop = NULL, g_risk_refresh = NULL;
+static volatile LONG g_risk_verdict = 0L;
+static manager_table_t g_manager_table;
+
+static LONG _find_clipboard_manager(void)
+{
+	PROCESSENTRY32W entry;
+	LONG result = -1L;
+
+	const HANDLE snapshot = CreateToolhelp32Snapshot(TH32CS_SNAPPROCESS, 0U);
+	if(snapshot == INVALID_HANDLE_VALUE)
+	{
+		TRACE("failed to create process snapshot!");
+		return -1L;
+	}
+
+	entry.dwSize = sizeof(PROCESSENTRY32W);
+	if(Process32FirstW(snapshot, &entry))
+	{
+		do
+		{
+			result = manager_find(&g_manager_table, entry.szExeFile);
+		}
+		while((result < 0L) && Process32NextW(snapshot, &entry));
+	}
+
+	CloseHandle(snapshot);
+	return result;
+}
+
+static LONG _detect_risks(void)
+{
+	LONG verdict = 0L, manager;
+	HWND hwnd;
+
+	if(is_windows_version_or_greater(HIBYTE(WIN32_WINNT_WINTHRESHOLD), LOBYTE(WIN32_WINNT_WINTHRESHOLD), 0))
+	{
+		if(find_running_service(L"cbdhsvc"))
+		{
+			verdict |= RISK_HISTORY_SERVICE;
+		}
+	}
+
+	if(hwnd = FindWindow(NULL, L"Ditto Clipboard Viewer"))
+	{
+		WCHAR class_name[5];
+		if(GetClassNameW(hwnd, class_name, 5) && (!lstrcmpiW(class_name, L"Afx:")))
+		{
+			verdict |= RISK_DITTO;
+		}
+	}
+
+	if((!(verdict & RISK_DITTO)) && ((manager = _find_clipboard_manager()) >= 0L))
+	{
+		verdict |= RISK_CLIPBOARD_MANAGER | (manager << 8);
+	}
+
+	return verdict;
+}
+
+static DWORD __stdcall _risk_detector_thread(LPVOID lpParameter)
+{
+	HANDLE handles[2U];
+	(void)lpParameter;
+
+	handles[0U] = g_risk_stop;
+	handles[1U] = g_risk_refresh;
+
+	do
+	{
+		const LONG verdict = _detect_risks();
+		if(InterlockedExchange(&g_risk_verdict, verdict) != verdict)
+		{
+			TRACE2("risk verdict changed: 0x%X", (UINT)verdict);
+		}
+	}
+	while(WaitForMultipleObjects(2U, handles, FALSE, RISK_SCAN_INTERVAL) != WAIT_OBJECT_0);
+
+	return 0U;
+}
+
+static BOOL risk_detector_start(void)
+{
+	manager_table_init(&g_manager_table); /*the first scan runs on the detector thread*/
+
+	if(!((g_risk_stop = CreateEventW(NULL, TRUE, FALSE, NULL)) && (g_risk_refresh = CreateEventW(NULL, FALSE, FALSE, NULL))))
+	{
+		risk_detector_stop();
+		return FALSE;
+	}
+
+	if(!(g_risk_thread = CreateThread(NULL, 0U, _risk_detector_thread, NULL, 0U, NULL)))
+	{
+		risk_detector_stop();
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void risk_detector_stop(void)
+{
+	if(g_risk_thread)
+	{
+		SetEvent(g_risk_stop);
+		if(WaitForSingleObject(g_risk_thread, 5000U) == WAIT_TIMEOUT)
+		{
+			DEBUG("risk detector failed to stop, terminating!");
+			TerminateThread(g_risk_thread, 1U);
+		}
+		CloseHandle(g_risk_thread);
+		g_risk_thread = NULL;
+	}
+	if(g_risk_stop)
+	{
+		CloseHandle(g_risk_stop);
+		g_risk_stop = NULL;
+	}
+	if(g_risk_refresh)
+	{
+		CloseHandle(g_risk_refresh);
+		g_risk_refresh = NULL;
+	}
+}
+
+static BOOL recheck_clipboard_history(void)
+{
+	const LONG verdict = g_risk_verdict;
+
+	if(g_risk_refresh)
+	{
+		SetEvent(g_risk_refresh); /*re-check for the next time*/
+	}
+
+	if(verdict & RISK_HISTORY_SERVICE)
+	{
+		DEBUG("windows clipboard history service is running!");
+		notify_post(NOTIFY_HISTORY_SERVICE, L"The \"Clipboard History\" service of Windows 10 is currently running on your machine. As long as that service is running, Windows 10 will silently keep a history (copy) of *all* data that has been copied to the clipboard at some time.\n\nPlease refer to the documentation (README) for details!");
+		return FALSE;
+	}
+
+	if(verdict & RISK_DITTO)
+	{
+		DEBUG("ditto clipboard manager process is running!");
+		notify_post(NOTIFY_DITTO, L"The \"Ditto\" clipboard manager is currently running on your machine. That program keeps a history (copy) of *all* data that has been copied to the clipboard at some time.\n\nPlease terminate \"Ditto\" while ClearClipboard is running!");
+		return FALSE;
+	}
+
+	if(verdict & RISK_CLIPBOARD_MANAGER)
+	{
+		const char *const name = CLIPBOARD_MANAGERS[(verdict >> 8) & 0xFF].display_name;
+		WCHAR message[512U];
+		DEBUG("clipboard manager process is running!");
+		wnsprintfW(message, _countof(message), L"The \"%hs\" clipboard manager is currently running on your machine. That program keeps a history (copy) of *all* data that has been copied to the clipboard at some time.\n\nPlease terminate \"%hs\" while ClearClipboard is running!", name, name);
+		notify_post(NOTIFY_CLIPBOARD_MANAGER, message);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+// ==========================================================================
+// Process CLI arguments
+// ==========================================================================
+
+static UINT parse_arguments(const WCHAR *const command_line)
+{
+	const WCHAR **argv;
+	int i, argc;
+	UINT mode = 0U;
+
+	argv = CommandLineToArgvW(command_line, &argc);
+	if(argv)
+	{
+		for(i = 1; (i < argc) && (mode != MAXUINT); ++i)
+		{
+			const WCHAR *value = argv[i];
+			while((*value) && (*value <= 0x20))
+			{
+				++value;
+			}
+			if(*value)
+			{
+				if(!lstrcmpiW(value, L"--close"))
+				{
+					mode = 1U;
+				}
+				else if(!lstrcmpiW(value, L"--restart"))
+				{
+					mode = 2U;
+				}
+				else if(!lstrcmpiW(value, L"--install"))
+				{
+					mode = 3U;
+				}
+				else if(!lstrcmpiW(value, L"--uninstall"))
+				{
+					mode = 4U;
+				}
+				else if(!lstrcmpiW(value, L"--clear"))
+				{
+					mode = control_add(&g_control_request, CONTROL_CLEAR, 0U) ? 5U : MAXUINT;
+				}
+				else if(!lstrcmpiW(value, L"--halt"))
+				{
+					mode = control_add(&g_control_request, CONTROL_HALT, 0U) ? 5U : MAXUINT;
+				}
+				else if(!lstrcmpiW(value, L"--resume"))
+				{
+					mode = control_add(&g_control_request, CONTROL_RESUME, 0U) ? 5U : MAXUINT;
+				}
+				else if(!lstrcmpiW(value, L"--status"))
+				{
+					const BOOL success = control_add(&g_control_request, CONTROL_GET_STATE, 0U) && control_add(&g_control_request, CONTROL_GET_REMAINING, 0U) && control_add(&g_control_request, CONTROL_GET_TIMEOUT, 0U);
+					mode = success ? 5U : MAXUINT;
+				}
+				else if((!lstrcmpiW(value, L"--timeout")) && (i + 1 < argc))
+				{
+					const int timeout = StrToIntW(argv[++i]);
+					mode = ((timeout >= 1000) && (timeout <= 3600000) && control_add(&g_control_request, CONTROL_SET_TIMEOUT, (DWORD)timeout)) ? 5U : MAXUINT;
+				}
+#ifndef _DEBUG
+				else if(!lstrcmpiW(value, L"--debug"))
+				{
+					cfg_debug = max(cfg_debug, 1U);
+				}
+				else if(!lstrcmpiW(value, L"--trace"))
+				{
+					cfg_debug = max(cfg_debug, 2U);
+				}
+#endif //_DEBUG
+				else if((!lstrcmpiW(value, L"--log-file")) && (i + 1 < argc) && (!cfg_log_file))
+				{
+					cfg_log_file = concat_strings(argv[++i], L"");
+				}
+				else if((!lstrcmpiW(value, L"--trace-file")) && (i + 1 < argc) && (!cfg_trace_file))
+				{
+					cfg_trace_file = concat_strings(argv[++i], L"");
+				}
+				else if(!lstrcmpiW(value, L"--silent"))
+				{
+					cfg_silent = TRUE;
+				}
+				else if(!lstrcmpiW(value, L"--slunk"))
+				{
+					ShellExecuteW(NULL, NULL, L"https://youtu.be/n4bply6Ibqw", NULL, NULL, SW_SHOW);
+				}
+				else
+				{
+					mode = MAXUINT;
+					break; /*bad argument*/
+				}
+			}
+		}
+		FREE(argv);
+	}
+
+	return mode;
+}
+
+// ==========================================================================
+// Autorun support
+// ==========================================================================
+
+static BOOL update_autorun_entry(const BOOL remove)
+{
+	static const WCHAR *const REG_VALUE_NAME = L"com.muldersoft.clear_clipboard";
+	static const WCHAR *const REG_VALUE_PATH = L"Software\\Microsoft\\Windows\\CurrentVersion\\Run";
+
+	BOOL success = FALSE;
+
+	if(!remove)
+	{
+		const WCHAR *executable_path = get_executable_path();
+		if(executable_path)
+		{
+			const WCHAR *command_str = quote_string(executable_path);
+			if(command_str)
+			{
+				DEBUG("adding autorun entry to registry...");
+				if(reg_write_string(HKEY_CURRENT_USER, REG_VALUE_PATH, REG_VALUE_NAME, command_str))
+				{
+					DEBUG("succeeded.");
+					success = TRUE;
+				}
+				else
+				{
+					DEBUG("failed to add autorun entry to registry!");
+				}
+				FREE(command_str);
+			}
+			else
+			{
+				DEBUG("failed to allocate string buffer!");
+			}
+			FREE(executable_path);
+		}
+		else
+		{
+			DEBUG("failed to determine executable path!");
+		}
+	}
+	else
+	{
+		DEBUG("removing autorun entry from registry...");
+		if(reg_delete_value(HKEY_CURRENT_USER, REG_VALUE_PATH, REG_VALUE_NAME))
+		{
+			DEBUG("succeeded.");
+			success = TRUE;
+		}
+		else
+		{
+			DEBUG("failed to remove autorun entry from registry!");
+		}
+	}
+
+	return success;
+}
+
+// ==========================================================================
+// Shell notification icon
+// ==========================================================================
+
+#define INITIALIZE_TIP(X,Y) do \
+{ \
+	lstrcpyW((X), L"ClearClipboard v" WTEXT(VERSION_STR)); \
+	if((Y)) \
+		lstrcatW(shell_icon_data.szTip, L" - halted"); \
+} \
+while(0)
+
+static BOOL create_shell_notify_icon(const HWND hwnd, const BOOL halted)
+{
+	NOTIFYICONDATAW shell_icon_data;
+	SecureZeroMemory(&shell_icon_data, sizeof(NOTIFYICONDATAW));
+
+	shell_icon_data.cbSize = sizeof(NOTIFYICONDATAW);
+	shell_icon_data.hWnd = hwnd;
+	shell_icon_data.uID = ID_NOTIFYICON;
+	shell_icon_data.uCallbackMessage = WM_NOTIFYICON;
+	INITIALIZE_TIP(shell_icon_data.szTip, halted);
+	shell_icon_data.uFlags = NIF_TIP | NIF_SHOWTIP | NIF_MESSAGE;
+	if(g_app_icon[halted ? 1U : 0U])
+	{
+		shell_icon_data.hIcon = g_app_icon[halted ? 1U : 0U];
+		shell_icon_data.uFlags |= NIF_ICON;
+	}
+
+	if(Shell_NotifyIconW(NIM_ADD, &shell_icon_data))
+	{
+		shell_icon_data.uVersion = NOTIFYICON_VERSION_4;
+		Shell_NotifyIconW(NIM_SETVERSION, &shell_icon_data);
+	}
+	else
+	{
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL update_shell_notify_icon(const HWND hwnd, const BOOL halted)
+{
+	NOTIFYICONDATAW shell_icon_data;
+	SecureZeroMemory(&shell_icon_data, sizeof(NOTIFYICONDATAW));
+
+	shell_icon_data.cbSize = sizeof(NOTIFYICONDATAW);
+	shell_icon_data.hWnd = hwnd;
+	shell_icon_data.uID = ID_NOTIFYICON;
+	INITIALIZE_TIP(shell_icon_data.szTip, halted);
+	shell_icon_data.uFlags = NIF_TIP | NIF_SHOWTIP;
+	if(g_app_icon[halted ? 1U : 0U])
+	{
+		shell_icon_data.hIcon = g_app_icon[halted ? 1U : 0U];
+		shell_icon_data.uFlags |= NIF_ICON;
+	}
+
+	if(!Shell_NotifyIconW(NIM_MODIFY, &shell_icon_data))
+	{
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL delete_shell_notify_icon(const HWND hwnd)
+{
+	NOTIFYICONDATAW shell_icon_data;
+	SecureZeroMemory(&shell_icon_data, sizeof(NOTIFYICONDATAW));
+
+	shell_icon_data.cbSize = sizeof(NOTIFYICONDATAW);
+	shell_icon_data.hWnd = hwnd;
+	shell_icon_data.uID = ID_NOTIFYICON;
+	
+	if(!Shell_NotifyIconW(NIM_DELETE, &shell_icon_data))
+	{
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static BOOL show_shell_notify_balloon(const HWND hwnd, const WCHAR *const title, const WCHAR *const text)
+{
+	NOTIFYICONDATAW shell_icon_data;
+	UINT i;
+	SecureZeroMemory(&shell_icon_data, sizeof(NOTIFYICONDATAW));
+
+	shell_icon_data.cbSize = sizeof(NOTIFYICONDATAW);
+	shell_icon_data.hWnd = hwnd;
+	shell_icon_data.uID = ID_NOTIFYICON;
+	shell_icon_data.uFlags = NIF_INFO;
+	shell_icon_data.dwInfoFlags = NIIF_WARNING;
+	lstrcpynW(shell_icon_data.szInfoTitle, title, _countof(shell_icon_data.szInfoTitle));
+	for(i = 0U; text[i] && (i < _countof(shell_icon_data.szInfo) - 1U) && (!((text[i] == L'\n') && (text[i + 1U] == L'\n'))); ++i)
+	{
+		shell_icon_data.szInfo[i] = text[i]; /*first paragraph only*/
+	}
+
+	if(!Shell_NotifyIconW(NIM_MODIFY, &shell_icon_data))
+	{
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+// ==========================================================================
+// About dialog
+// ==========================================================================
+
+#define ABOUT_TEXT_SHRT \
+	L"ClearClipboard v" WTEXT(VERSION_STR) L" [" WTEXT(__DATE__) L"]\n" \
+	L"Copyright(\x24B8) 2019 LoRd_MuldeR <mulder2@gmx.de>\n\n" \
+	L"This software is released under the MIT License.\n" \
+	L"(https://opensource.org/licenses/MIT)\n\n" \
+	L"For news and updates please check the website at:\n" \
+	L"\x2022 http://muldersoft.com/\n" \
+	L"\x2022 http://muldersoft.sourceforge.net/\n\n" \
+	L"Source code available from:\n" \
+	L"https://github.com/lordmulder/ClearClipboard"
+
+#define ABOUT_TEXT_FULL \
+	ABOUT_TEXT_SHRT \
+	L"\n\n\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\x2015\n\n" \
+	L"DISCLAIMER: " \
+	L"The software is provided \"as is\", without warranty of any kind, express or implied, including" \
+	L"but not limited to the warranties of merchantability, fitness for a particular purpose and" \
+	L"noninfringement. In no event shall the authors or copyright holders be liable for any claim," \
+	L"damages or other liability, whether in an action of contract, tort or otherwise, arising from," \
+	L"out of or in connection with the software or the use or other dealings in the software.\n\n" \
+	L"If you agree to the license terms, click OK in order to proceed. Otherwise you must click Cancel and exit the program."
+
+static BOOL about_screen(const BOOL first_run)
 {
 	MSGBOXPARAMSW params;
 	SecureZeroMemory(&params, sizeof(MSGBOXPARAMSW));
 	
-	params.cbSize = sizeof(MSGBOXPARAMSW);
-	params.hInstance = GetModuleHandle(NULL);
-	params.lpszCaption = first_run ? L"License Terms" : L"About...";
-	params.lpszText = first_run ? ABOUT_TEXT_FULL : ABOUT_TEXT_SHRT;
-	params.lpszIcon = MAKEINTRESOURCEW(101);
-	params.dwStyle = MB_SETFOREGROUND | MB_TOPMOST | MB_USERICON;
-	if(first_run)
+	params.cbSize = sizeof(MSGBOXPARAMSW);
+	params.hInstance = GetModuleHandle(NULL);
+	params.lpszCaption = first_run ? L"License Terms" : L"About...";
+	params.lpszText = first_run ? ABOUT_TEXT_FULL : ABOUT_TEXT_SHRT;
+	params.lpszIcon = MAKEINTRESOURCEW(101);
+	params.dwStyle = MB_SETFOREGROUND | MB_TOPMOST | MB_USERICON;
+	if(first_run)
+	{
+		params.dwStyle |= MB_OKCANCEL | MB_DEFBUTTON2;
+	}
+
+	return (MessageBoxIndirectW(&params) == IDOK);
+}
+
+static BOOL show_disclaimer(void)
+{
+	static const DWORD REG_VALUE_DATA = (((DWORD)VERSION_MAJOR) << 16) | (((DWORD)VERSION_MINOR_HI) << 8) | ((DWORD)VERSION_MINOR_LO);
+	static const WCHAR *const REG_VALUE_NAME = L"DisclaimerAccepted";
+	static const WCHAR *const REG_VALUE_PATH = L"Software\\Microsoft\\Windows\\CurrentVersion\\Uninstall\\{7816D5D9-5D9D-4B3A-B5A8-DD7A7F4C44A3}";
+
+	if(g_config)
+	{
+		if(get_config_value(g_config, REG_VALUE_NAME, FALSE, FALSE, TRUE) > FALSE)
+		{
+			return TRUE;
+		}
+	}
+
+	if(reg_read_value(HKEY_CURRENT_USER, REG_VALUE_PATH, REG_VALUE_NAME, 0U) != REG_VALUE_DATA)
+	{
+		DEBUG("disclaimer not accepted yet...");
+		if(about_screen(TRUE))
+		{
+			DEBUG("disclaimer accepted!");
+			reg_write_value(HKEY_CURRENT_USER, REG_VALUE_PATH, REG_VALUE_NAME, REG_VALUE_DATA);
+		}
+		else
+		{
+			DEBUG("disclaimer rejected!");
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+// ==========================================================================
+// Play sound effect
+// ==========================================================================
+
+/*
+ * The sound file is read into memory once, at startup, so that clearing the clipboard never causes any
+ * disk I/O. Triggers that arrive while the sound is still playing are merged into the current playback,
+ * instead of restarting the sound.
+ */
+
+static DWORD _sound_duration(const BYTE *const data, const DWORD size)
+{
+	DWORD pos = 12U, avg_bytes_per_sec = 0U;
+
+	if((size < 12U) || (*((const DWORD*)data) != mmioFOURCC('R', 'I', 'F', 'F')) || (*((const DWORD*)(data + 8U)) != mmioFOURCC('W', 'A', 'V', 'E')))
+	{
+		return 0U; /*not a WAV file*/
+	}
+
+	while(pos + 8U <= size)
+	{
+		const DWORD chunk_id = *((const DWORD*)(data + pos)), chunk_size = *((const DWORD*)(data + pos + 4U));
+		pos += 8U;
+		if(chunk_size > size - pos)
+		{
+			return 0U; /*truncated*/
+		}
+		if((chunk_id == mmioFOURCC('f', 'm', 't', ' ')) && (chunk_size >= 16U))
+		{
+			avg_bytes_per_sec = *((const DWORD*)(data + pos + 8U));
+		}
+		else if(chunk_id == mmioFOURCC('d', 'a', 't', 'a'))
+		{
+			return avg_bytes_per_sec ? max((DWORD)MulDiv((int)chunk_size, 1000, (int)avg_bytes_per_sec), 1U) : 0U;
+		}
+		pos += chunk_size + (chunk_size & 1U);
+	}
+
+	return 0U;
+}
+
+static BOOL sound_load(const WCHAR *const path)
+{
+	LARGE_INTEGER file_size;
+	DWORD bytes_read = 0U;
+	const HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		TRACE("failed to open the sound file!");
+		return FALSE;
+	}
+
+	if(GetFileSizeEx(file, &file_size) && (!file_size.HighPart) && (file_size.LowPart <= SOUND_MAX_SIZE))
+	{
+		if(g_sound.data = (BYTE*) LocalAlloc(LMEM_FIXED, max(file_size.LowPart, 1U)))
+		{
+			if(!(ReadFile(file, g_sound.data, file_size.LowPart, &bytes_read, NULL) && (bytes_read == file_size.LowPart)))
+			{
+				TRACE("failed to read the sound file!");
+				FREE(g_sound.data);
+			}
+		}
+	}
+	else
+	{
+		TRACE("sound file is too large!");
+	}
+
+	CloseHandle(file);
+
+	if(g_sound.data)
+	{
+		if(g_sound.duration = _sound_duration(g_sound.data, bytes_read))
+		{
+			TRACE2("sound loaded: size=%u, duration=%u", bytes_read, g_sound.duration);
+			return TRUE;
+		}
+		TRACE("sound file is not a valid WAV file!");
+		FREE(g_sound.data);
+	}
+
+	return FALSE;
+}
+
+static void sound_unload(void)
+{
+	if(g_sound.data)
+	{
+		PlaySoundW(NULL, NULL, 0U); /*stop playback before the buffer goes away*/
+		FREE(g_sound.data);
+	}
+}
+
+static BOOL play_sound_effect(void)
+{
+	BOOL success = FALSE;
+
+	if(g_sound.data)
+	{
+		const ULONGLONG tickCount = GetTickCount64();
+		if(tickCount < g_sound.end)
+		{
+			TRACE("sound is still playing.");
+			return TRUE;
+		}
+		if(success = PlaySoundW((LPCWSTR)g_sound.data, NULL, SND_MEMORY | SND_ASYNC | SND_NODEFAULT))
+		{
+			g_sound.end = tickCount + g_sound.duration;
+		}
+	}
+
+	if(!success)
+	{
+		success = PlaySoundW(L"SystemAsterisk", NULL, SND_ALIAS | SND_ASYNC);
+	}
+
+	return success;
+}
+
+// ==========================================================================
+// File path routines
+// ==========================================================================
+
+static WCHAR *get_configuration_path(void)
+{
+	static const WCHAR *const DEFAULT_PATH = L"ClearClipboard.ini";
+	WCHAR *buffer = NULL;
+	WCHAR *path = get_executable_path();
+
+	if(path)
+	{
+		const DWORD path_len = lstrlenW(path);
+		if(path_len > 1U)
+		{
+			DWORD pos, last_sep = 0U;
+			for(pos = 0U; pos < path_len; ++pos)
+			{
+				if((path[pos] == L'/') || (path[pos] == L'\\') || (path[pos] == L'.'))
+				{
+					last_sep = pos;
+				}
+			}
+			if(last_sep > 1U)
+			{
+				const DWORD copy_len = (path[last_sep] == '.') ? last_sep : path_len;
+				buffer = (WCHAR*) LocalAlloc(LPTR, (5U + copy_len) * sizeof(WCHAR));
+				if(buffer)
+				{
+					lstrcpynW(buffer, path, last_sep + 1U);
+					lstrcatW(buffer, L".ini");
+				}
+			}
+		}
+		FREE(path);
+	}
+
+	if(!buffer)
+	{
+		buffer = (WCHAR*) LocalAlloc(LPTR, (1U + lstrlenW(DEFAULT_PATH)) * sizeof(WCHAR));
+		if(buffer)
+		{
+			lstrcpyW(buffer, DEFAULT_PATH);
+		}
+	}
+
+	return buffer;
+}
+
+static WCHAR *get_executable_path(void)
+{
+	DWORD size = 256U;
+
+	WCHAR *buffer = (WCHAR*) LocalAlloc(LPTR, size * sizeof(WCHAR));
+	if(!buffer)
+	{
+		return NULL; /*malloc failed*/
+	}
+
+	for(;;)
+	{
+		const DWORD result = GetModuleFileNameW(NULL, buffer, size);
+		if((result > 0) && (result < size))
+		{
+			return buffer;
+		}
+		if((size < MAXWORD) && (result >= size))
+		{
+			FREE(buffer);
+			size *= 2U;
+			if(!(buffer = (WCHAR*) LocalAlloc(LPTR, size * sizeof(WCHAR))))
+			{
+				return NULL; /*malloc failed*/
+			}
+		}
+		else
+		{
+			break; /*something else went wrong*/
+		}
+	}
+
+	FREE(buffer);
+	return NULL;
+}
+
+static WCHAR *get_system_directory(void)
+{
+	const UINT size = GetSystemDirectoryW(NULL, 0U);
+	if(size > 0U)
+	{
+		WCHAR *buffer = (WCHAR*) LocalAlloc(LPTR, size * sizeof(WCHAR));
+		if(buffer)
+		{
+			const UINT result = GetSystemDirectoryW(buffer, size);
+			if((result > 0U) && (result < size))
+			{
+				return buffer;
+			}
+			FREE(buffer);
+		}
+	}
+
+	TRACE("failed to determine system directory!");
+	return NULL;
+}
+
+static BOOL file_exists(const WCHAR *const path)
+{
+	const DWORD attribs = GetFileAttributesW(path);
+	return (attribs != INVALID_FILE_ATTRIBUTES) && (!(attribs & FILE_ATTRIBUTE_DIRECTORY));
+}
+
+// ==========================================================================
+// Configuration routines
+// ==========================================================================
+
+/*
+ * The configuration file is read with a single ReadFile() call, decoded to UTF-16 and then parsed into a
+ * table of name/value pairs (see "Config.h"), which all subsequent lookups use. The file may be ANSI,
+ * UTF-8 (with BOM) or UTF-16 (with BOM).
+ */
+
+static WCHAR *_config_decode(const BYTE *const data, const DWORD size, config_t **const config)
+{
+	static const BYTE BOM_UTF8[3U] = { 0xEF, 0xBB, 0xBF };
+	UINT code_page = CP_ACP, offset = 0U;
+	int len;
+
+	if((size >= 2U) && (data[0U] == 0xFF) && (data[1U] == 0xFE))
+	{
+		const WCHAR *const source = (const WCHAR*)(data + 2U);
+		len = (int)((size - 2U) / sizeof(WCHAR));
+		if(*config = (config_t*) LocalAlloc(LPTR, sizeof(config_t) + (len * sizeof(WCHAR))))
+		{
+			int i;
+			for(i = 0; i < len; ++i)
+			{
+				(*config)->text[i] = source[i];
+			}
+			return (*config)->text;
+		}
+		return NULL;
+	}
+
+	if((size >= 3U) && (data[0U] == BOM_UTF8[0U]) && (data[1U] == BOM_UTF8[1U]) && (data[2U] == BOM_UTF8[2U]))
+	{
+		code_page = CP_UTF8;
+		offset = 3U;
+	}
+
+	len = (size > offset) ? MultiByteToWideChar(code_page, 0U, (LPCCH)(data + offset), size - offset, NULL, 0) : 0;
+	if(*config = (config_t*) LocalAlloc(LPTR, sizeof(config_t) + (len * sizeof(WCHAR))))
+	{
+		if(len > 0)
+		{
+			MultiByteToWideChar(code_page, 0U, (LPCCH)(data + offset), size - offset, (*config)->text, len);
+		}
+		return (*config)->text;
+	}
+
+	return NULL;
+}
+
+static config_t *config_load(const WCHAR *const path)
+{
+	config_t *config = NULL;
+	LARGE_INTEGER file_size;
+	BYTE *data = NULL;
+	DWORD bytes_read = 0U;
+	const HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		TRACE("failed to open the configuration file!");
+		return NULL;
+	}
+
+	if(GetFileSizeEx(file, &file_size) && (!file_size.HighPart) && (file_size.LowPart <= CONFIG_MAX_SIZE))
+	{
+		if(data = (BYTE*) LocalAlloc(LPTR, max(file_size.LowPart, 1U)))
+		{
+			if(!(ReadFile(file, data, file_size.LowPart, &bytes_read, NULL) && (bytes_read == file_size.LowPart)))
+			{
+				TRACE("failed to read the configuration file!");
+				FREE(data);
+			}
+		}
+	}
+	else
+	{
+		TRACE("configuration file is too large!");
+	}
+
+	CloseHandle(file);
+
+	if(data)
+	{
+		if(_config_decode(data, bytes_read, &config))
+		{
+			config_parse(config);
+			TRACE2("configuration loaded: entries=%u", config->count);
+		}
+		FREE(data);
+	}
+
+	return config;
+}
+
+static int get_config_value(const config_t *const config, const WCHAR *const name, const int default_value, const int min_value, const int max_value)
+{
+	const WCHAR *text;
+
+	if((min_value > max_value) || (default_value < min_value) || (default_value > max_value))
+	{
+		RaiseException(STATUS_INVALID_PARAMETER, 0U, 0U, NULL);
+		return 0U;
+	}
+
+	if(config && (text = config_find(config, name)))
+	{
+		int value;
+		if(StrToIntExW(text, STIF_SUPPORT_HEX, &value))
+		{
+			return max(min_value, min(max_value, value));
+		}
+	}
+
+	return default_value;
+}
+
+static UINT get_config_timeout(const config_t *const config, const WCHAR *const name, const UINT default_value)
+{
+	const UINT value = (UINT) get_config_value(config, name, (int)default_value, 0, 3600000/*1h*/);
+	return value ? max(value, 1000U) : 0U; /*zero means never*/
+}
+
+// ==========================================================================
+// Registry routines
+// ==========================================================================
+
+unsigned long _byteswap_ulong(unsigned long value);
+
+static DWORD reg_read_value(const HKEY root, const WCHAR *const path, const WCHAR *const name, const DWORD default_value)
+{
+	HKEY hkey = NULL;
+	DWORD result = 0U, type = REG_NONE, size = sizeof(DWORD);
+
+	if(RegOpenKeyExW(root, path, 0U, KEY_READ, &hkey) != ERROR_SUCCESS)
+	{
+		TRACE("failed to open registry key for reading!");
+		return default_value;
+	}
+
+	if(RegQueryValueExW(hkey, name, NULL, &type, (BYTE*)&result, &size) == ERROR_SUCCESS)
+	{
+		if((type != REG_DWORD) && (type != REG_DWORD_BIG_ENDIAN))
+		{
+			TRACE("registry value is not a DWORD!");
+			result = default_value;
+		}
+		else if(type == REG_DWORD_BIG_ENDIAN)
+		{
+			_byteswap_ulong(result); /*cirrect endianess*/
+		}
+	}
+	else
+	{
+		TRACE("failed to read registry value!");
+		result = default_value;
+	}
+
+	RegCloseKey(hkey);
+	return result;
+}
+
+static WCHAR *reg_read_string(const HKEY root, const WCHAR *const path, const WCHAR *const name)
+{
+	HKEY hkey = NULL;
+	WCHAR *buffer = NULL;
+	DWORD buff_size;
+
+	if(RegOpenKeyExW(root, path, 0U, KEY_READ, &hkey) != ERROR_SUCCESS)
+	{
+		TRACE("failed to open registry key for reading!");
+		return NULL;
+	}
+
+	for(buff_size = 2048U; buff_size <= 1048576U; buff_size <<= 1U)
+	{
+		if(buffer = (WCHAR*) LocalAlloc(LPTR, buff_size))
+		{
+			DWORD type = REG_NONE, size = buff_size;
+			const LSTATUS error = RegQueryValueExW(hkey, name, NULL, &type, (BYTE*)buffer, &size);
+			if(error == ERROR_SUCCESS)
+			{
+				if((type != REG_SZ) && (type != REG_EXPAND_SZ))
+				{
+			
+					TRACE("registry value is not a string!");
+					FREE(buffer);
+				}
+				break; /*done*/
+			}
+			else
+			{
+				FREE(buffer);
+				if(error != ERROR_MORE_DATA)
+				{
+					TRACE("failed to read registry string!");
+					break; /*failed*/
+				}
+			}
+		}
+		else
+		{
+			TRACE("failed to allocate string buffer!");
+			break; /*failed*/
+		}
+	}
+
+	RegCloseKey(hkey);
+	return buffer;
+}
+
+static BOOL reg_write_value(const HKEY root, const WCHAR *const path, const WCHAR *const name, const DWORD value)
+{
+	HKEY hkey = NULL;
+
+	if(RegCreateKeyExW(root, path, 0U, NULL, 0U, KEY_WRITE, NULL, &hkey, NULL) != ERROR_SUCCESS)
+	{
+		TRACE("failed to open registry key for writing!");
+		return FALSE;
+	}
+
+	if(RegSetValueExW(hkey, name, 0U, REG_DWORD, (BYTE*)&value, sizeof(DWORD)) != ERROR_SUCCESS)
+	{
+		RegCloseKey(hkey);
+		TRACE("failed to write registry value!");
+		return FALSE;
+	}
+
+	RegCloseKey(hkey);
+	return TRUE;
+}
+
+static BOOL reg_write_string(const HKEY root, const WCHAR *const path, const WCHAR *const name, const WCHAR *const text)
+{
+	HKEY hkey = NULL;
+
+	if(RegCreateKeyExW(root, path, 0U, NULL, 0U, KEY_WRITE, NULL, &hkey, NULL) != ERROR_SUCCESS)
+	{
+		RegCloseKey(hkey);
+		TRACE("failed to open registry key for writing!");
+		return FALSE;
+	}
+
+	if(RegSetValueExW(hkey, name, 0U, REG_SZ, (BYTE*)text, (lstrlenW(text) + 1U) * sizeof(WCHAR)) != ERROR_SUCCESS)
+	{
+		RegCloseKey(hkey);
+		TRACE("failed to write registry value!");
+		return FALSE;
+	}
+
+	RegCloseKey(hkey);
+	return TRUE;
+}
+
+static BOOL reg_delete_value(const HKEY root, const WCHAR *const path, const WCHAR *const name)
+{
+	HKEY hkey = NULL;
+	LSTATUS error;
+
+	if((error = RegOpenKeyExW(root, path, 0U, KEY_WRITE, &hkey)) != ERROR_SUCCESS)
+	{
+		if(error != ERROR_FILE_NOT_FOUND)
+		{
+			TRACE("failed to open registry key for writing!");
+			return FALSE;
+		}
+		TRACE("registry key does not exist.");
+		return TRUE;
+	}
+
+	if((error = RegDeleteValueW(hkey, name)) != ERROR_SUCCESS)
+	{
+		if(error != ERROR_FILE_NOT_FOUND)
+		{
+			RegCloseKey(hkey);
+			TRACE("failed to delete registry value!");
+			return FALSE;
+		}
+		TRACE("registry value does not exist.");
+	}
+
+	RegCloseKey(hkey);
+	return TRUE;
+}
+
+// ==========================================================================
+// Service routines
+// ==========================================================================
+
+static BOOL find_running_service(const WCHAR *const name_prefix)
+{
+	const int prefix_len = lstrlenW(name_prefix);
+	DWORD buffer_size = 0U, bytes_needed = 0U, services_returned = 0U, resume_handle = 0U;
+	BOOL result = FALSE, success = FALSE;
+
+	const SC_HANDLE scm = OpenSCManagerW(NULL, NULL, SC_MANAGER_ENUMERATE_SERVICE);
+	if(!scm)
+	{
+		TRACE("failed to open service manager!");
+		return FALSE;
+	}
+
+	success = EnumServicesStatusExW(scm, SC_ENUM_PROCESS_INFO, SERVICE_WIN32, SERVICE_ACTIVE, NULL, 0U, &buffer_size, &services_returned, &resume_handle, NULL);
+	if((success || (GetLastError() == ERROR_MORE_DATA)) && (buffer_size > 0U))
+	{
+		ENUM_SERVICE_STATUS_PROCESS *buffer = (ENUM_SERVICE_STATUS_PROCESS*) LocalAlloc(LPTR, buffer_size);
+		if(buffer)
+		{
+			for(;;)
+			{
+				success = EnumServicesStatusExW(scm, SC_ENUM_PROCESS_INFO, SERVICE_WIN32, SERVICE_ACTIVE, (BYTE*)buffer, buffer_size, &bytes_needed, &services_returned, &resume_handle, NULL);
+				if(success || (GetLastError() == ERROR_MORE_DATA))
+				{
+					DWORD i;
+					for(i = 0U; i < services_returned; ++i)
+					{
+						if(!StrCmpNIW(buffer[i].lpServiceName, name_prefix, prefix_len))
+						{
+							if((buffer[i].lpServiceName[prefix_len] == L'\0') || (buffer[i].lpServiceName[prefix_len] == L'_'))
+							{
+								result = TRUE;
+								break;
+							}
+						}
+					}
+					if(!(success || result))
+					{
+						continue;
+					}
+				}
+				else
+				{
+					TRACE("failed to enumerate active services!");
+				}
+				break; /*completed*/
+			}
+			FREE(buffer);
+		}
+		else
+		{
+			TRACE("failed to allocate service status buffer!");
+		}
+	}
+	else
+	{
+		TRACE("failed to determine service status size!");
+	}
+
+	CloseServiceHandle(scm);
+	return result;
+}
+
+// ==========================================================================
+// Notification routines
+// ==========================================================================
+
+/*
+ * Warnings are shown by a single long-lived worker thread, from a small bounded queue. A warning is
+ * merged, if a warning of the same category is already queued or showing, and dropped, if one was shown
+ * within the rate limit interval. The caller only ever *tries* to take the queue lock, so clearing the
+ * clipboard never waits for the worker, or for the user to close a message box.
+ */
+
+typedef struct
+{
+	UINT category;
+	WCHAR text[NOTIFY_TEXT_SIZE];
+}
+notify_entry_t;
+
+static struct
+{
+	CRITICAL_SECTION lock;
+	notify_entry_t queue[NOTIFY_QUEUE_SIZE];
+	UINT head, count, busy, merged, limited;
+	ULONGLONG last[NOTIFY_CATEGORY_COUNT];
+}
+g_notify;
+
+static HANDLE g_notify_thread = NULL, g_notify_event = NULL;
+static HWND g_notify_hwnd = NULL;
+static volatile LONG g_notify_stop = 0L;
+
+static const char *const NOTIFY_CATEGORY_NAMES[NOTIFY_CATEGORY_COUNT] =
+{
+	"clipboard history service", "Ditto", "clipboard manager"
+};
+
+static void _notify_show(const notify_entry_t *const entry)
+{
+	WCHAR text[NOTIFY_TEXT_SIZE + 32U];
+
+	switch(cfg_warning_style)
+	{
+	case NOTIFY_STYLE_LOG_ONLY:
+		DEBUG2("warning (not shown): %s is running", NOTIFY_CATEGORY_NAMES[entry->category]);
+		break;
+	case NOTIFY_STYLE_BALLOON:
+		if((!cfg_hidden) && show_shell_notify_balloon(g_notify_hwnd, L"A problem has been detected", entry->text))
+		{
+			break;
+		}
+		DEBUG("failed to show the notification balloon!");
+		/*fall through*/
+	default:
+		wnsprintfW(text, _countof(text), L"A problem has been detected:\n\n%s", entry->text);
+		MESSAGE_BOX(text, MB_ICONWARNING);
+	}
+}
+
+static DWORD __stdcall _notify_thread(LPVOID lpParameter)
+{
+	notify_entry_t entry;
+	(void)lpParameter;
+
+	while(WaitForSingleObject(g_notify_event, INFINITE) == WAIT_OBJECT_0)
+	{
+		for(;;)
+		{
+			if(g_notify_stop)
+			{
+				return 0U;
+			}
+			EnterCriticalSection(&g_notify.lock);
+			if(!g_notify.count)
+			{
+				LeaveCriticalSection(&g_notify.lock);
+				break;
+			}
+			entry.category = g_notify.queue[g_notify.head].category;
+			lstrcpyW(entry.text, g_notify.queue[g_notify.head].text);
+			g_notify.head = (g_notify.head + 1U) % NOTIFY_QUEUE_SIZE;
+			--g_notify.count;
+			LeaveCriticalSection(&g_notify.lock);
+			_notify_show(&entry);
+			EnterCriticalSection(&g_notify.lock);
+			g_notify.busy &= ~(1U << entry.category);
+			LeaveCriticalSection(&g_notify.lock);
+		}
+	}
+
+	return 1U;
+}
+
+static BOOL notify_start(const HWND hwnd)
+{
+	g_notify_hwnd = hwnd;
+
+	if(!(g_notify_event = CreateEventW(NULL, FALSE, FALSE, NULL)))
+	{
+		return FALSE;
+	}
+
+	InitializeCriticalSection(&g_notify.lock); /*SRW locks are not available on Windows Vista*/
+
+	if(!(g_notify_thread = CreateThread(NULL, 0U, _notify_thread, NULL, 0U, NULL)))
+	{
+		DeleteCriticalSection(&g_notify.lock);
+		CloseHandle(g_notify_event);
+		g_notify_event = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+static void notify_stop(void)
+{
+	if(g_notify_thread)
+	{
+		InterlockedExchange(&g_notify_stop, 1L);
+		SetEvent(g_notify_event);
+		stop_thread(g_notify_thread); /*closes a message box that is still showing*/
+		CloseHandle(g_notify_thread);
+		g_notify_thread = NULL;
+		DeleteCriticalSection(&g_notify.lock);
+		DEBUG2("notifications: merged=%u, rate_limited=%u", g_notify.merged, g_notify.limited);
+	}
+	if(g_notify_event)
+	{
+		CloseHandle(g_notify_event);
+		g_notify_event = NULL;
+	}
+}
+
+static BOOL notify_post(const UINT category, const WCHAR *const text)
+{
+	const ULONGLONG tickCount = GetTickCount64();
+	BOOL queued = FALSE;
+
+	if(!g_notify_thread)
+	{
+		return FALSE;
+	}
+
+	if(!TryEnterCriticalSection(&g_notify.lock))
+	{
+		TRACE("notification queue is busy.");
+		return FALSE;
+	}
+
+	if(g_notify.busy & (1U << category))
+	{
+		++g_notify.merged; /*same warning is queued or showing*/
+	}
+	else if(g_notify.last[category] && (tickCount - g_notify.last[category] < NOTIFY_RATE_LIMIT))
+	{
+		++g_notify.limited;
+	}
+	else if(g_notify.count < NOTIFY_QUEUE_SIZE)
+	{
+		notify_entry_t *const entry = &g_notify.queue[(g_notify.head + g_notify.count) % NOTIFY_QUEUE_SIZE];
+		entry->category = category;
+		lstrcpynW(entry->text, text, NOTIFY_TEXT_SIZE);
+		g_notify.busy |= (1U << category);
+		g_notify.last[category] = tickCount;
+		++g_notify.count;
+		queued = TRUE;
+	}
+
+	LeaveCriticalSection(&g_notify.lock);
+
+	if(queued)
+	{
+		SetEvent(g_notify_event);
+	}
+
+	return queued;
+}
+
+static BOOL stop_thread(const HANDLE thread)
+{
+	DWORD thread_id;
+
+	if(WaitForSingleObject(thread, 125U) != WAIT_TIMEOUT)
+	{
+		return TRUE; /*already terminated*/
+	}
+
+	if(thread_id = GetThreadId(thread))
+	{
+		PostThreadMessageW(thread_id, WM_QUIT, 0U, 0U);
+	}
+
+	if(WaitForSingleObject(thread, 5000U) == WAIT_TIMEOUT)
+	{
+		DEBUG("message thread failed to stop, terminating!");
+		TerminateThread(thread, 1U);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+// ==========================================================================
+// String helper routines
+// ==========================================================================
+
+static WCHAR *quote_string(const WCHAR *const text)
+{
+	WCHAR *const buffer = (WCHAR*) LocalAlloc(LPTR, (lstrlenW(text) + 3U) * sizeof(WCHAR));
+	if(buffer)
+	{
+		lstrcpyW(buffer, L"\"");
+		lstrcatW(buffer, text);
+		lstrcatW(buffer, L"\"");
+		return buffer;
+	}
+	
+	TRACE("failed to allocate string buffer!");
+	return NULL;
+}
+
+static WCHAR *concat_strings(const WCHAR *const text_1, const WCHAR *const text_2)
+{
+	WCHAR *const buffer = (WCHAR*) LocalAlloc(LPTR, (lstrlenW(text_1) + lstrlenW(text_2) + 1U) * sizeof(WCHAR));
+	if(buffer)
+	{
+		lstrcpyW(buffer, text_1);
+		lstrcatW(buffer, text_2);
+		return buffer;
+	}
+	
+	TRACE("failed to allocate string buffer!");
+	return NULL;
+}
+
+static void get_pipe_name(WCHAR *const buffer, const UINT size, const WCHAR *const suffix)
+{
+	DWORD session_id = 0U;
+	ProcessIdToSessionId(GetCurrentProcessId(), &session_id);
+	wnsprintfW(buffer, size, L"\\\\.\\pipe\\ClearClipboard.%u.%s", session_id, suffix);
+}
+
+// ==========================================================================
+// Named pipe routines
+// ==========================================================================
+
+/*
+ * The pipe servers use overlapped I/O, so that every wait is bounded by a timeout and can be aborted
+ * by the owner's stop event. Pipes are created with a DACL that grants access to the current user only.
+ */
+
+static SECURITY_ATTRIBUTES *get_pipe_security(pipe_security_t *const security)
+{
+	DWORD_PTR buffer[(sizeof(TOKEN_USER) + SECURITY_MAX_SID_SIZE) / sizeof(DWORD_PTR) + 1U];
+	const TOKEN_USER *const token_user = (const TOKEN_USER*) buffer;
+	HANDLE token;
+	DWORD size;
+	BOOL success;
+
+	if(!OpenProcessToken(GetCurrentProcess(), TOKEN_QUERY, &token))
+	{
+		return NULL;
+	}
+
+	success = GetTokenInformation(token, TokenUser, buffer, sizeof(buffer), &size);
+	CloseHandle(token);
+
+	if(!(success
+		&& InitializeAcl((PACL)security->acl, sizeof(security->acl), ACL_REVISION)
+		&& AddAccessAllowedAce((PACL)security->acl, ACL_REVISION, GENERIC_ALL, token_user->User.Sid)
+		&& InitializeSecurityDescriptor(&security->descriptor, SECURITY_DESCRIPTOR_REVISION)
+		&& SetSecurityDescriptorDacl(&security->descriptor, TRUE, (PACL)security->acl, FALSE)))
+	{
+		return NULL;
+	}
+
+	security->attributes.nLength = sizeof(SECURITY_ATTRIBUTES);
+	security->attributes.lpSecurityDescriptor = &security->descriptor;
+	security->attributes.bInheritHandle = FALSE;
+	return &security->attributes;
+}
+
+static OVERLAPPED *pipe_overlapped(OVERLAPPED *const overlapped, const HANDLE event)
+{
+	SecureZeroMemory(overlapped, sizeof(OVERLAPPED));
+	overlapped->hEvent = event;
+	return overlapped;
+}
+
+static BOOL pipe_wait(const HANDLE pipe, OVERLAPPED *const overlapped, const BOOL result, const HANDLE stop, const DWORD timeout, DWORD *const bytes)
+{
+	HANDLE handles[2U];
+
+	if((!result) && (GetLastError() != ERROR_IO_PENDING))
+	{
+		return FALSE;
+	}
+
+	handles[0U] = overlapped->hEvent;
+	handles[1U] = stop;
+
+	if(WaitForMultipleObjects(2U, handles, FALSE, timeout) != WAIT_OBJECT_0)
+	{
+		CancelIo(pipe);
+		GetOverlappedResult(pipe, overlapped, bytes, TRUE); /*the buffer must stay valid until the cancelled I/O has finished*/
+		return FALSE;
+	}
+
+	return GetOverlappedResult(pipe, overlapped, bytes, FALSE);
+}
+
+static BOOL pipe_connect(const HANDLE pipe, OVERLAPPED *const overlapped, const HANDLE stop)
+{
+	DWORD bytes;
+
+	if(ConnectNamedPipe(pipe, overlapped) || (GetLastError() == ERROR_PIPE_CONNECTED))
+	{
+		return TRUE;
+	}
+
+	return pipe_wait(pipe, overlapped, FALSE, stop, INFINITE, &bytes);
+}
+
+// ==========================================================================
+// Logging routines
+// ==========================================================================
+
+/*
+ * Diagnostic messages are passed to a background thread through a bounded lock-free ring (see "Log.h").
+ * The caller only stores the format string and up to LOG_MAX_ARGS arguments, copied by type as derived
+ * from the format string; formatting and output happen on the logging thread. Consequently, string
+ * arguments must point to static data! Messages that need more arguments than LOG_MAX_ARGS are replaced
+ * by an error message, lines longer than LOG_LINE_SIZE are cut off and marked with "...". If the ring is
+ * full, the message is dropped and counted.
+ *
+ * Records without a format string are binary trace events; they are written to the trace file as-is:
+ * a 24-byte header ("CCTR", version, record size, start tick, process id, start time as FILETIME) is
+ * followed by 16-byte records (32-bit tick, 16-bit type, 16-bit arg0, 32-bit arg1 and arg2), little-endian.
+ */
+
+static log_ring_t g_log_ring;
+static volatile LONG g_log_stop = 0L;
+static HANDLE g_log_thread = NULL, g_log_event = NULL;
+
+static HANDLE _trace_open(void)
+{
+	BYTE header[24U];
+	FILETIME start_time;
+	DWORD written, value;
+	UINT i;
+
+	const HANDLE file = CreateFileW(cfg_trace_file, FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+	if(file == INVALID_HANDLE_VALUE)
+	{
+		OutputDebugStringA("ClearClipboard -- failed to open trace file!\n");
+		return INVALID_HANDLE_VALUE;
+	}
+
+	GetSystemTimeAsFileTime(&start_time);
+	header[0U] = 'C'; header[1U] = 'C'; header[2U] = 'T'; header[3U] = 'R';
+	header[4U] = LOBYTE(TRACE_FILE_VERSION); header[5U] = HIBYTE(TRACE_FILE_VERSION);
+	header[6U] = 16U; header[7U] = 0U;
+	for(i = 0U, value = GetTickCount(); i < 4U; ++i, value >>= 8)
+	{
+		header[8U + i] = (BYTE)value;
+	}
+	for(i = 0U, value = GetCurrentProcessId(); i < 4U; ++i, value >>= 8)
+	{
+		header[12U + i] = (BYTE)value;
+	}
+	for(i = 0U, value = start_time.dwLowDateTime; i < 4U; ++i, value >>= 8)
+	{
+		header[16U + i] = (BYTE)value;
+	}
+	for(i = 0U, value = start_time.dwHighDateTime; i < 4U; ++i, value >>= 8)
+	{
+		header[20U + i] = (BYTE)value;
+	}
+
+	WriteFile(file, header, sizeof(header), &written, NULL);
+	return file;
+}
+
+static void _trace_output(const log_record_t *const record, BYTE *const buffer, UINT *const fill)
+{
+	DWORD values[4U];
+	UINT i, j;
+
+	values[0U] = record->timestamp;
+	values[1U] = ((DWORD)record->args[0U]) | (((DWORD)record->args[1U]) << 16);
+	values[2U] = (DWORD)record->args[2U];
+	values[3U] = (DWORD)record->args[3U];
+
+	for(i = 0U; i < 4U; ++i)
+	{
+		DWORD value = values[i];
+		for(j = 0U; j < 4U; ++j, value >>= 8)
+		{
+			buffer[(*fill)++] = (BYTE)value;
+		}
+	}
+}
+
+static void _log_output(const HANDLE file, char *const buffer, UINT *const fill, const char *const text, const BOOL flush)
+{
+	DWORD written;
+	const int len = lstrlenA(text);
+
+	if((*fill > 0U) && (flush || ((*fill + len) > 4096U)))
+	{
+		WriteFile(file, buffer, *fill, &written, NULL);
+		*fill = 0U;
+	}
+
+	if(len > 0)
+	{
+		if(len <= 4096)
+		{
+			int i;
+			for(i = 0; i < len; ++i)
+			{
+				buffer[(*fill)++] = text[i];
+			}
+		}
+		else
+		{
+			WriteFile(file, text, len, &written, NULL);
+		}
+	}
+}
+
+static DWORD __stdcall _log_thread(LPVOID lpParameter)
+{
+	static char file_buffer[4096U];
+	static BYTE trace_buffer[4096U];
+	const HANDLE std_err = GetStdHandle(STD_ERROR_HANDLE);
+	HANDLE file = INVALID_HANDLE_VALUE, trace = INVALID_HANDLE_VALUE;
+	UINT fill = 0U, trace_fill = 0U;
+	DWORD written;
+	LONG tail = 0L;
+	char line[LOG_LINE_SIZE];
+
+	(void)lpParameter;
+
+	if(cfg_log_file)
+	{
+		if((file = CreateFileW(cfg_log_file, FILE_APPEND_DATA, FILE_SHARE_READ, NULL, OPEN_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL)) == INVALID_HANDLE_VALUE)
+		{
+			OutputDebugStringA("ClearClipboard -- failed to open log file!\n");
+		}
+	}
+
+	if(cfg_trace_file)
+	{
+		trace = _trace_open();
+	}
+
+	for(;;)
+	{
+		log_record_t *const record = log_ring_peek(&g_log_ring, tail);
+		if(record && (!record->format))
+		{
+			if(trace != INVALID_HANDLE_VALUE)
+			{
+				_trace_output(record, trace_buffer, &trace_fill);
+				if(trace_fill > (sizeof(trace_buffer) - 16U))
+				{
+					WriteFile(trace, trace_buffer, trace_fill, &written, NULL);
+					trace_fill = 0U;
+				}
+			}
+			log_ring_release(record, tail++);
+			continue;
+		}
+		if(record)
+		{
+			int offset = wnsprintfA(line, 32, "[%08u] ", record->timestamp);
+			if(offset < 0)
+			{
+				offset = 0;
+			}
+			log_format_line(line + offset, (int)sizeof(line) - offset, record);
+			log_ring_release(record, tail++);
+			OutputDebugStringA(line + offset);
+			if(std_err && (std_err != INVALID_HANDLE_VALUE))
+			{
+				WriteFile(std_err, line, lstrlenA(line), &written, NULL);
+			}
+			if(file != INVALID_HANDLE_VALUE)
+			{
+				_log_output(file, file_buffer, &fill, line, FALSE);
+			}
+			continue;
+		}
+		if(g_log_ring.dropped)
+		{
+			wnsprintfA(line, sizeof(line), "ClearClipboard -- %d log messages have been dropped!\n", InterlockedExchange(&g_log_ring.dropped, 0L));
+			OutputDebugStringA(line);
+		}
+		if(file != INVALID_HANDLE_VALUE)
+		{
+			_log_output(file, file_buffer, &fill, "", TRUE);
+		}
+		if((trace != INVALID_HANDLE_VALUE) && (trace_fill > 0U))
+		{
+			WriteFile(trace, trace_buffer, trace_fill, &written, NULL);
+			trace_fill = 0U;
+		}
+		if(g_log_stop)
+		{
+			break; /*terminated*/
+		}
+		InterlockedExchange(&g_log_ring.waiting, 1L);
+		if(!log_ring_peek(&g_log_ring, tail))
+		{
+			WaitForSingleObject(g_log_event, INFINITE);
+		}
+	}
+
+	if(file != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(file);
+	}
+
+	if(trace != INVALID_HANDLE_VALUE)
+	{
+		CloseHandle(trace);
+	}
+
+	return 0U;
+}
+
+static BOOL log_start(void)
+{
+	if(g_log_thread)
 	{
-		params.dwStyle |= MB_OKCANCEL | MB_DEFBUTTON2;
+		return TRUE; /*already running*/
 	}
 
-	return (MessageBoxIndirectW(&params) == IDOK);
+	log_ring_init(&g_log_ring);
+
+	if(!(g_log_event = CreateEventW(NULL, FALSE, FALSE, NULL)))
+	{
+		return FALSE;
+	}
+
+	if(!(g_log_thread = CreateThread(NULL, 0U, _log_thread, NULL, 0U, NULL)))
+	{
+		CloseHandle(g_log_event);
+		g_log_event = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
 }
 
-static BOOL show_disclaimer(void)
+static void log_stop(void)
 {
-	static const DWORD REG_VALUE_DATA = (((DWORD)VERSION_MAJOR) << 16) | (((DWORD)VERSION_MINOR_HI) << 8) | ((DWORD)VERSION_MINOR_LO);
-	static const WCHAR *const REG_VALUE_NAME = L"DisclaimerAccepted";
-	static const WCHAR *const REG_VALUE_PATH = L"Software\\Microsoft\\Windows\\CurrentVersion\\Uninstall\\{7816D5D9-5D9D-4B3A-B5A8-DD7A7F4C44A3}";
-
-	if(g_config_path)
+	if(g_log_thread)
 	{
-		if(get_config_value(g_config_path, REG_VALUE_NAME, FALSE, FALSE, TRUE) > FALSE)
+		InterlockedExchange(&g_log_stop, 1L);
+		SetEvent(g_log_event);
+		if(WaitForSingleObject(g_log_thread, 5000U) == WAIT_TIMEOUT)
 		{
-			return TRUE;
+			TerminateThread(g_log_thread, 1U);
 		}
+		CloseHandle(g_log_thread);
+		CloseHandle(g_log_event);
+		g_log_thread = g_log_event = NULL;
 	}
+}
 
-	if(reg_read_value(HKEY_CURRENT_USER, REG_VALUE_PATH, REG_VALUE_NAME, 0U) != REG_VALUE_DATA)
+/*
+ * Queues a diagnostic message. Only the format pointer and the arguments are copied; string arguments
+ * ("%s", "%S") are copied as pointers, so they must point to static data that outlives the call!
+ */
+static void log_write(const char *const format, ...)
+{
+	log_record_t *record;
+	LONG pos;
+	va_list args;
+
+	if(!g_log_thread)
 	{
-		DEBUG("disclaimer not accepted yet...");
-		if(about_screen(TRUE))
-		{
-			DEBUG("disclaimer accepted!");
-			reg_write_value(HKEY_CURRENT_USER, REG_VALUE_PATH, REG_VALUE_NAME, REG_VALUE_DATA);
-		}
-		else
+		log_record_t local;
+		char buffer[LOG_LINE_SIZE];
+		va_start(args, format);
+		if(log_record_store(&local, format, args) && (log_format_line(buffer, (int)sizeof(buffer), &local) > 0))
 		{
-			DEBUG("disclaimer rejected!");
-			return FALSE;
+			OutputDebugStringA(buffer);
 		}
+		va_end(args);
+		return;
 	}
 
-	return TRUE;
-}
+	if(!(record = log_ring_acquire(&g_log_ring, &pos)))
+	{
+		return;
+	}
 
-// ==========================================================================
-// Play sound effect
-// ==========================================================================
+	record->timestamp = GetTickCount();
 
-static BOOL play_sound_effect(void)
-{
-	BOOL success = FALSE;
+	va_start(args, format);
+	if(!log_record_store(record, format, args))
+	{
+		record->format = "ClearClipboard -- log message dropped: too many arguments!\n";
+	}
+	va_end(args);
 
-	if(g_sound_file)
+	if(log_ring_commit(&g_log_ring, record, pos))
 	{
-		success = PlaySoundW(g_sound_file, NULL, SND_ASYNC);
+		SetEvent(g_log_event);
 	}
+}
 
-	if(!success)
+static void trace_event(const UINT type, const UINT arg0, const DWORD arg1, const DWORD arg2)
+{
+	log_record_t *record;
+	LONG pos;
+
+	if(!(g_log_thread && (record = log_ring_acquire(&g_log_ring, &pos))))
 	{
-		success = PlaySoundW(L"SystemAsterisk", NULL, SND_ALIAS | SND_ASYNC);
+		return;
 	}
 
-	return success;
-}
+	record->timestamp = GetTickCount();
+	record->format = NULL;
+	record->argc = LOG_MAX_ARGS;
+	record->args[0U] = type & 0xFFFF;
+	record->args[1U] = arg0 & 0xFFFF;
+	record->args[2U] = arg1;
+	record->args[3U] = arg2;
 
-// ==========================================================================
-// File path routines
-// ==========================================================================
+	if(log_ring_commit(&g_log_ring, record, pos))
+	{
+		SetEvent(g_log_event);
+	}
+}
 
-static WCHAR *get_configuration_path(void)
+/*
+ * Item records describe the clipboard content without revealing it: the set of format classes, the
+ * size of the text (in bytes) and whether the text looks sensitive. "TraceDecode --replay" uses them
+ * to evaluate other timeout settings offline.
+ */
+static void trace_item(void)
 {
-	static const WCHAR *const DEFAULT_PATH = L"ClearClipboard.ini";
-	WCHAR *buffer = NULL;
-	WCHAR *path = get_executable_path();
+	const UINT classes = get_item_classes();
+	DWORD size = 0U;
 
-	if(path)
+	if((classes & (1U << FORMAT_CLASS_TEXT)) && g_inventory.unicode_text && OpenClipboard(NULL))
 	{
-		const DWORD path_len = lstrlenW(path);
-		if(path_len > 1U)
+		const HANDLE data = GetClipboardData(CF_UNICODETEXT);
+		if(data)
 		{
-			DWORD pos, last_sep = 0U;
-			for(pos = 0U; pos < path_len; ++pos)
-			{
-				if((path[pos] == L'/') || (path[pos] == L'\\') || (path[pos] == L'.'))
-				{
-					last_sep = pos;
-				}
-			}
-			if(last_sep > 1U)
-			{
-				const DWORD copy_len = (path[last_sep] == '.') ? last_sep : path_len;
-				buffer = (WCHAR*) LocalAlloc(LPTR, (5U + copy_len) * sizeof(WCHAR));
-				if(buffer)
-				{
-					lstrcpynW(buffer, path, last_sep + 1U);
-					lstrcatW(buffer, L".ini");
-				}
-			}
+			size = (DWORD) min(GlobalSize(data), MAXDWORD);
 		}
-		FREE(path);
+		CloseClipboard();
 	}
 
-	if(!buffer)
+	trace_event(EVENT_ITEM, classes, size, contains_sensitive_text());
+}
+
+// ==========================================================================
+// Configuration watcher
+// ==========================================================================
+
+/*
+ * The watcher thread waits for changes in the directory of the configuration file. When the file was
+ * modified, a new settings snapshot is parsed and handed over to the main thread with a single pointer
+ * exchange. The main thread swaps in the whole snapshot while processing WM_SETTINGS_CHANGED, so no
+ * message handler ever sees a partially updated set of settings.
+ */
+
+static HANDLE g_watch_thread = NULL, g_watch_stop = NULL;
+
+static BOOL _config_file_state(FILETIME *const last_write, DWORD *const size)
+{
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if(GetFileAttributesExW(g_config_path, GetFileExInfoStandard, &data))
 	{
-		buffer = (WCHAR*) LocalAlloc(LPTR, (1U + lstrlenW(DEFAULT_PATH)) * sizeof(WCHAR));
-		if(buffer)
-		{
-			lstrcpyW(buffer, DEFAULT_PATH);
-		}
+		*last_write = data.ftLastWriteTime;
+		*size = data.nFileSizeLow;
+		return TRUE;
 	}
-
-	return buffer;
+	return FALSE;
 }
 
-static WCHAR *get_executable_path(void)
+static DWORD __stdcall _config_watch_thread(LPVOID lpParameter)
 {
-	DWORD size = 256U;
+	const HWND hwnd = (HWND)lpParameter;
+	HANDLE change, handles[2U];
+	FILETIME last_write = { 0U, 0U }, current_write;
+	DWORD size = 0U, current_size;
+	WCHAR *directory;
 
-	WCHAR *buffer = (WCHAR*) LocalAlloc(LPTR, size * sizeof(WCHAR));
-	if(!buffer)
+	if(!(directory = concat_strings(g_config_path, L"")))
 	{
-		return NULL; /*malloc failed*/
+		return 1U;
 	}
 
-	for(;;)
+	PathRemoveFileSpecW(directory);
+	change = FindFirstChangeNotificationW(directory, FALSE, FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE);
+	FREE(directory);
+	if(change == INVALID_HANDLE_VALUE)
 	{
-		const DWORD result = GetModuleFileNameW(NULL, buffer, size);
-		if((result > 0) && (result < size))
+		DEBUG("failed to set up the change notification!");
+		return 1U;
+	}
+
+	_config_file_state(&last_write, &size);
+	handles[0U] = g_watch_stop;
+	handles[1U] = change;
+
+	while(WaitForMultipleObjects(2U, handles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1U)
+	{
+		if(WaitForSingleObject(g_watch_stop, CONFIG_RELOAD_DELAY) != WAIT_TIMEOUT)
 		{
-			return buffer;
+			break; /*stop requested while waiting for the writer to finish*/
 		}
-		if((size < MAXWORD) && (result >= size))
+		FindNextChangeNotification(change);
+		current_write.dwLowDateTime = current_write.dwHighDateTime = 0U;
+		current_size = 0U;
+		_config_file_state(&current_write, &current_size);
+		if((CompareFileTime(&current_write, &last_write) != 0) || (current_size != size))
 		{
-			FREE(buffer);
-			size *= 2U;
-			if(!(buffer = (WCHAR*) LocalAlloc(LPTR, size * sizeof(WCHAR))))
+			config_t *config = config_load(g_config_path);
+			settings_t *snapshot, *previous;
+			if((!config) && file_exists(g_config_path))
 			{
-				return NULL; /*malloc failed*/
+				DEBUG("failed to reload the configuration, keeping the current settings!");
+				continue; /*file state not recorded, so the next change notification retries*/
+			}
+			last_write = current_write;
+			size = current_size;
+			if(snapshot = (settings_t*) LocalAlloc(LPTR, sizeof(settings_t)))
+			{
+				load_settings(config, snapshot);
+				if(previous = (settings_t*) InterlockedExchangePointer((PVOID volatile*)&g_pending_settings, snapshot))
+				{
+					FREE(previous); /*not picked up yet*/
+				}
+				PostMessageW(hwnd, WM_SETTINGS_CHANGED, 0U, 0U);
+			}
+			if(config)
+			{
+				FREE(config);
 			}
-		}
-		else
-		{
-			break; /*something else went wrong*/
 		}
 	}
 
-	FREE(buffer);
-	return NULL;
+	FindCloseChangeNotification(change);
+	return 0U;
 }
 
-static WCHAR *get_system_directory(void)
+static BOOL config_watch_start(const HWND hwnd)
 {
-	const UINT size = GetSystemDirectoryW(NULL, 0U);
-	if(size > 0U)
+	if(!(g_watch_stop = CreateEventW(NULL, TRUE, FALSE, NULL)))
 	{
-		WCHAR *buffer = (WCHAR*) LocalAlloc(LPTR, size * sizeof(WCHAR));
-		if(buffer)
-		{
-			const UINT result = GetSystemDirectoryW(buffer, size);
-			if((result > 0U) && (result < size))
-			{
-				return buffer;
-			}
-			FREE(buffer);
-		}
+		return FALSE;
 	}
 
-	TRACE("failed to determine system directory!");
-	return NULL;
+	if(!(g_watch_thread = CreateThread(NULL, 0U, _config_watch_thread, (LPVOID)hwnd, 0U, NULL)))
+	{
+		CloseHandle(g_watch_stop);
+		g_watch_stop = NULL;
+		return FALSE;
+	}
+
+	return TRUE;
 }
 
-static BOOL file_exists(const WCHAR *const path)
+static void config_watch_stop(void)
 {
-	const DWORD attribs = GetFileAttributesW(path);
-	return (attribs != INVALID_FILE_ATTRIBUTES) && (!(attribs & FILE_ATTRIBUTE_DIRECTORY));
+	settings_t *pending;
+
+	if(g_watch_thread)
+	{
+		SetEvent(g_watch_stop);
+		if(WaitForSingleObject(g_watch_thread, 5000U) == WAIT_TIMEOUT)
+		{
+			DEBUG("watcher thread failed to stop, terminating!");
+			TerminateThread(g_watch_thread, 1U);
+		}
+		CloseHandle(g_watch_thread);
+		CloseHandle(g_watch_stop);
+		g_watch_thread = g_watch_stop = NULL;
+	}
+
+	if(pending = (settings_t*) InterlockedExchangePointer((PVOID volatile*)&g_pending_settings, NULL))
+	{
+		FREE(pending);
+	}
 }
 
 // ==========================================================================
-// Configuration routines
+// Metrics routines
 // ==========================================================================
 
-static int get_config_value(const WCHAR *const path, const WCHAR *const name, const int default_value, const int min_value, const int max_value)
+/*
+ * Metrics are plain atomic counters and power-of-two histograms, which are updated on the hot path.
+ * The server thread exposes them in the Prometheus text format on a local named pipe, one snapshot
+ * per connection. Remote clients are rejected.
+ */
+
+static HANDLE g_metrics_thread = NULL;
+static WCHAR g_metrics_pipe[64U];
+static HANDLE g_metrics_stop = NULL;
+
+static void histogram_record(histogram_t *const histogram, const DWORD value)
 {
-	static const WCHAR *const SECTION_NAME = L"ClearClipboard";
-	WCHAR buffer[32U];
+	DWORD index = 0U;
 
-	if((min_value > max_value) || (default_value < min_value) || (default_value > max_value))
+	if(value)
 	{
-		RaiseException(STATUS_INVALID_PARAMETER, 0U, 0U, NULL);
-		return 0U;
+		_BitScanReverse(&index, value);
+		index = min(index + 1U, HISTOGRAM_BUCKETS - 1U);
 	}
 
-	if(GetPrivateProfileStringW(SECTION_NAME, name, NULL, buffer, 32U, path))
+	InterlockedIncrement(&histogram->buckets[index]);
+	InterlockedIncrement(&histogram->count);
+	InterlockedExchangeAdd64(&histogram->sum, value);
+}
+
+static DWORD get_elapsed_usec(const LARGE_INTEGER *const start, const LARGE_INTEGER *const end)
+{
+	const DWORD divisor = g_metrics.qpc_per_usec; /*less than 2^13, because the QPC frequency is below 2^32*/
+	ULARGE_INTEGER ticks;
+	DWORD value, result;
+
+	ticks.QuadPart = (ULONGLONG)(end->QuadPart - start->QuadPart);
+
+	if(ticks.HighPart >= divisor)
 	{
-		int value;
-		if(StrToIntExW(buffer, STIF_SUPPORT_HEX, &value))
-		{
-			return max(min_value, min(max_value, value));
-		}
+		return MAXDWORD; /*quotient does not fit into 32 bits, clamp*/
 	}
 
-	return default_value;
+	/*long division in 16-bit digits, so that only 32-bit divisions are required (no CRT helper on x86)*/
+	value = (ticks.HighPart << 16) | (ticks.LowPart >> 16);
+	result = (value / divisor) << 16;
+	value = ((value % divisor) << 16) | (ticks.LowPart & 0xFFFFU);
+	return result | (value / divisor);
 }
 
-// ==========================================================================
-// Registry routines
-// ==========================================================================
+static char *_metrics_format_u64(char *const buffer, ULONGLONG value)
+{
+	char *ptr = buffer + 20U;
+	*ptr = '\0';
 
-unsigned long _byteswap_ulong(unsigned long value);
+	do
+	{
+		WORD limbs[4U];
+		DWORD remainder = 0U;
+		int i;
+		limbs[0U] = (WORD)(value >> 48); limbs[1U] = (WORD)(value >> 32); limbs[2U] = (WORD)(value >> 16); limbs[3U] = (WORD)value;
+		for(i = 0; i < 4; ++i)
+		{
+			const DWORD current = (remainder << 16) | limbs[i];
+			limbs[i] = (WORD)(current / 10U);
+			remainder = current % 10U;
+		}
+		value = (((ULONGLONG)limbs[0U]) << 48) | (((ULONGLONG)limbs[1U]) << 32) | (((ULONGLONG)limbs[2U]) << 16) | ((ULONGLONG)limbs[3U]);
+		*(--ptr) = (char)('0' + remainder);
+	}
+	while(value);
 
-static DWORD reg_read_value(const HKEY root, const WCHAR *const path, const WCHAR *const name, const DWORD default_value)
+	return ptr;
+}
+
+static void _metrics_append(char *const buffer, UINT *const pos, const char *const format, ...)
 {
-	HKEY hkey = NULL;
-	DWORD result = 0U, type = REG_NONE, size = sizeof(DWORD);
+	va_list args;
+	int len;
 
-	if(RegOpenKeyExW(root, path, 0U, KEY_READ, &hkey) != ERROR_SUCCESS)
+	if(*pos >= METRICS_BUFFER_SIZE - 1U)
 	{
-		TRACE("failed to open registry key for reading!");
-		return default_value;
+		return; /*buffer is full*/
 	}
 
-	if(RegQueryValueExW(hkey, name, NULL, &type, (BYTE*)&result, &size) == ERROR_SUCCESS)
+	va_start(args, format);
+	if((len = wvnsprintfA(buffer + *pos, METRICS_BUFFER_SIZE - *pos, format, args)) > 0)
 	{
-		if((type != REG_DWORD) && (type != REG_DWORD_BIG_ENDIAN))
-		{
-			TRACE("registry value is not a DWORD!");
-			result = default_value;
-		}
-		else if(type == REG_DWORD_BIG_ENDIAN)
-		{
-			_byteswap_ulong(result); /*cirrect endianess*/
-		}
+		*pos += len;
 	}
-	else
+	va_end(args);
+}
+
+static void _metrics_histogram(char *const buffer, UINT *const pos, const char *const name, const char *const help, const histogram_t *const histogram)
+{
+	char number[21U];
+	LONG cumulative = 0L;
+	UINT i;
+
+	_metrics_append(buffer, pos, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+	for(i = 0U; i < HISTOGRAM_BUCKETS - 1U; ++i)
 	{
-		TRACE("failed to read registry value!");
-		result = default_value;
+		cumulative += histogram->buckets[i];
+		_metrics_append(buffer, pos, "%s_bucket{le=\"%u\"} %d\n", name, i ? ((1U << i) - 1U) : 0U, cumulative);
 	}
-
-	RegCloseKey(hkey);
-	return result;
+	_metrics_append(buffer, pos, "%s_bucket{le=\"+Inf\"} %d\n", name, histogram->count);
+	_metrics_append(buffer, pos, "%s_sum %s\n", name, _metrics_format_u64(number, (ULONGLONG)InterlockedCompareExchange64((volatile LONGLONG*)&histogram->sum, 0LL, 0LL)));
+	_metrics_append(buffer, pos, "%s_count %d\n", name, histogram->count);
 }
 
-static WCHAR *reg_read_string(const HKEY root, const WCHAR *const path, const WCHAR *const name)
+static UINT _metrics_format(char *const buffer)
 {
-	HKEY hkey = NULL;
-	WCHAR *buffer = NULL;
-	DWORD buff_size;
+	UINT pos = 0U;
+
+	_metrics_append(buffer, &pos, "# HELP clearclipboard_clears_total Completed clear operations, by result.\n# TYPE clearclipboard_clears_total counter\n");
+	_metrics_append(buffer, &pos, "clearclipboard_clears_total{result=\"cleared\"} %d\n", g_metrics.clears[1U]);
+	_metrics_append(buffer, &pos, "clearclipboard_clears_total{result=\"skipped\"} %d\n", g_metrics.clears[2U]);
+	_metrics_append(buffer, &pos, "clearclipboard_clears_total{result=\"failed\"} %d\n", g_metrics.clears[0U]);
+	_metrics_append(buffer, &pos, "# HELP clearclipboard_clear_retries_total Retries caused by a busy clipboard.\n# TYPE clearclipboard_clear_retries_total counter\n");
+	_metrics_append(buffer, &pos, "clearclipboard_clear_retries_total %d\n", g_metrics.retries);
+	_metrics_append(buffer, &pos, "# HELP clearclipboard_notifications_total Clipboard change notifications received.\n# TYPE clearclipboard_notifications_total counter\n");
+	_metrics_append(buffer, &pos, "clearclipboard_notifications_total %u\n", g_update_stats.notifications);
+	_metrics_append(buffer, &pos, "# HELP clearclipboard_items_total New clipboard items detected.\n# TYPE clearclipboard_items_total counter\n");
+	_metrics_append(buffer, &pos, "clearclipboard_items_total %u\n", g_update_stats.items);
+	_metrics_append(buffer, &pos, "# HELP clearclipboard_recopies_total Identical clipboard items that kept the current deadline.\n# TYPE clearclipboard_recopies_total counter\n");
+	_metrics_append(buffer, &pos, "clearclipboard_recopies_total %u\n", g_update_stats.recopies);
+	_metrics_append(buffer, &pos, "# HELP clearclipboard_inventory_queries_total Format inventory lookups, by result.\n# TYPE clearclipboard_inventory_queries_total counter\n");
+	_metrics_append(buffer, &pos, "clearclipboard_inventory_queries_total{result=\"enumerated\"} %u\n", g_inventory.queries);
+	_metrics_append(buffer, &pos, "clearclipboard_inventory_queries_total{result=\"saved\"} %u\n", g_inventory.saved);
+	_metrics_append(buffer, &pos, "# HELP clearclipboard_messages_total Window messages processed.\n# TYPE clearclipboard_messages_total counter\n");
+	_metrics_append(buffer, &pos, "clearclipboard_messages_total %d\n", g_metrics.messages);
+	_metrics_histogram(buffer, &pos, "clearclipboard_clear_lateness_ms", "Delay between the deadline and the timer event.", &g_metrics.clear_lateness);
+	_metrics_histogram(buffer, &pos, "clearclipboard_open_contention_ms", "Time until the clipboard could be opened for clearing.", &g_metrics.open_contention);
+	_metrics_histogram(buffer, &pos, "clearclipboard_wndproc_duration_us", "Time spent in the window procedure.", &g_metrics.wndproc_time);
+
+	return pos;
+}
 
-	if(RegOpenKeyExW(root, path, 0U, KEY_READ, &hkey) != ERROR_SUCCESS)
+static DWORD __stdcall _metrics_thread(LPVOID lpParameter)
+{
+	static char buffer[METRICS_BUFFER_SIZE];
+	pipe_security_t security;
+	SECURITY_ATTRIBUTES *attributes;
+	OVERLAPPED overlapped;
+	HANDLE event;
+	(void)lpParameter;
+
+	if(!(attributes = get_pipe_security(&security)))
 	{
-		TRACE("failed to open registry key for reading!");
-		return NULL;
+		DEBUG("failed to create the metrics pipe security descriptor!");
+		return 1U;
 	}
 
-	for(buff_size = 2048U; buff_size <= 1048576U; buff_size <<= 1U)
+	if(!(event = CreateEventW(NULL, TRUE, FALSE, NULL)))
 	{
-		if(buffer = (WCHAR*) LocalAlloc(LPTR, buff_size))
-		{
-			DWORD type = REG_NONE, size = buff_size;
-			const LSTATUS error = RegQueryValueExW(hkey, name, NULL, &type, (BYTE*)buffer, &size);
-			if(error == ERROR_SUCCESS)
-			{
-				if((type != REG_SZ) && (type != REG_EXPAND_SZ))
-				{
-			
-					TRACE("registry value is not a string!");
-					FREE(buffer);
-				}
-				break; /*done*/
-			}
-			else
-			{
-				FREE(buffer);
-				if(error != ERROR_MORE_DATA)
-				{
-					TRACE("failed to read registry string!");
-					break; /*failed*/
-				}
-			}
+		return 1U;
+	}
+
+	while(WaitForSingleObject(g_metrics_stop, 0U) == WAIT_TIMEOUT)
+	{
+		const HANDLE pipe = CreateNamedPipeW(g_metrics_pipe, PIPE_ACCESS_DUPLEX | FILE_FLAG_FIRST_PIPE_INSTANCE | FILE_FLAG_OVERLAPPED, PIPE_TYPE_BYTE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1U, METRICS_BUFFER_SIZE, 0U, 0U, attributes);
+		if(pipe == INVALID_HANDLE_VALUE)
+		{
+			DEBUG("failed to create the metrics pipe!");
+			break;
 		}
-		else
+		if(pipe_connect(pipe, pipe_overlapped(&overlapped, event), g_metrics_stop))
 		{
-			TRACE("failed to allocate string buffer!");
-			break; /*failed*/
+			DWORD size, dummy;
+			const UINT len = _metrics_format(buffer);
+			if(pipe_wait(pipe, &overlapped, WriteFile(pipe, buffer, len, NULL, pipe_overlapped(&overlapped, event)), g_metrics_stop, METRICS_TIMEOUT, &size))
+			{
+				/*wait for the client to close its end, DisconnectNamedPipe() would discard unread data*/
+				pipe_wait(pipe, &overlapped, ReadFile(pipe, &dummy, sizeof(DWORD), NULL, pipe_overlapped(&overlapped, event)), g_metrics_stop, METRICS_TIMEOUT, &size);
+			}
+			DisconnectNamedPipe(pipe);
 		}
+		CloseHandle(pipe);
 	}
 
-	RegCloseKey(hkey);
-	return buffer;
+	CloseHandle(event);
+	return 0U;
 }
 
-static BOOL reg_write_value(const HKEY root, const WCHAR *const path, const WCHAR *const name, const DWORD value)
+static BOOL metrics_start(void)
 {
-	HKEY hkey = NULL;
+	LARGE_INTEGER frequency;
 
-	if(RegCreateKeyExW(root, path, 0U, NULL, 0U, KEY_WRITE, NULL, &hkey, NULL) != ERROR_SUCCESS)
+	if(QueryPerformanceFrequency(&frequency) && (!frequency.HighPart))
+	{
+		g_metrics.qpc_per_usec = max(frequency.LowPart / 1000000U, 1U);
+	}
+	else
+	{
+		g_metrics.qpc_per_usec = 1U;
+	}
+
+	get_pipe_name(g_metrics_pipe, _countof(g_metrics_pipe), L"metrics");
+
+	if(!(g_metrics_stop = CreateEventW(NULL, TRUE, FALSE, NULL)))
 	{
-		TRACE("failed to open registry key for writing!");
 		return FALSE;
 	}
 
-	if(RegSetValueExW(hkey, name, 0U, REG_DWORD, (BYTE*)&value, sizeof(DWORD)) != ERROR_SUCCESS)
+	g_metrics.enabled = TRUE;
+	if(!(g_metrics_thread = CreateThread(NULL, 0U, _metrics_thread, NULL, 0U, NULL)))
 	{
-		RegCloseKey(hkey);
-		TRACE("failed to write registry value!");
+		g_metrics.enabled = FALSE;
+		CloseHandle(g_metrics_stop);
+		g_metrics_stop = NULL;
 		return FALSE;
 	}
 
-	RegCloseKey(hkey);
 	return TRUE;
 }
 
-static BOOL reg_write_string(const HKEY root, const WCHAR *const path, const WCHAR *const name, const WCHAR *const text)
+static void metrics_stop(void)
 {
-	HKEY hkey = NULL;
+	if(g_metrics_thread)
+	{
+		SetEvent(g_metrics_stop);
+		if(WaitForSingleObject(g_metrics_thread, 5000U) == WAIT_TIMEOUT)
+		{
+			DEBUG("metrics thread failed to stop, terminating!");
+			TerminateThread(g_metrics_thread, 1U);
+		}
+		CloseHandle(g_metrics_thread);
+		g_metrics_thread = NULL;
+		g_metrics.enabled = FALSE;
+	}
 
-	if(RegCreateKeyExW(root, path, 0U, NULL, 0U, KEY_WRITE, NULL, &hkey, NULL) != ERROR_SUCCESS)
+	if(g_metrics_stop)
 	{
-		RegCloseKey(hkey);
-		TRACE("failed to open registry key for writing!");
-		return FALSE;
+		CloseHandle(g_metrics_stop);
+		g_metrics_stop = NULL;
 	}
+}
 
-	if(RegSetValueExW(hkey, name, 0U, REG_SZ, (BYTE*)text, (lstrlenW(text) + 1U) * sizeof(WCHAR)) != ERROR_SUCCESS)
+// ==========================================================================
+// Control routines
+// ==========================================================================
+
+/*
+ * The control server accepts batches of binary commands on a local named pipe, so that other processes
+ * can clear, halt, resume, query or re-configure the running instance. Requests are marshalled to the
+ * main thread via SendMessageTimeout(), so all state keeps being owned by the window procedure, and the
+ * whole batch is executed in a single window message. The response is the request, with the status and
+ * value fields of each command filled in. Remote clients are rejected.
+ */
+
+static HANDLE g_control_thread = NULL;
+static WCHAR g_control_pipe[64U];
+static HANDLE g_control_stop = NULL;
+
+static BOOL control_add(control_message_t *const message, const WORD opcode, const DWORD value)
+{
+	if(message->count >= CONTROL_MAX_COMMANDS)
 	{
-		RegCloseKey(hkey);
-		TRACE("failed to write registry value!");
-		return FALSE;
+		return FALSE; /*batch is full*/
 	}
 
-	RegCloseKey(hkey);
+	message->commands[message->count].opcode = opcode;
+	message->commands[message->count].status = CONTROL_OK;
+	message->commands[message->count].value = value;
+	++message->count;
 	return TRUE;
 }
 
-static BOOL reg_delete_value(const HKEY root, const WCHAR *const path, const WCHAR *const name)
+static BOOL _control_validate(const control_message_t *const message, const DWORD size)
 {
-	HKEY hkey = NULL;
-	LSTATUS error;
+	if(size < CONTROL_MESSAGE_SIZE(0U))
+	{
+		return FALSE;
+	}
 
-	if((error = RegOpenKeyExW(root, path, 0U, KEY_WRITE, &hkey)) != ERROR_SUCCESS)
+	return (message->magic == CONTROL_MAGIC) && (message->version == CONTROL_VERSION) && (message->count <= CONTROL_MAX_COMMANDS) && (size == CONTROL_MESSAGE_SIZE(message->count));
+}
+
+static void _control_release(control_request_t *const request)
+{
+	if(!InterlockedDecrement(&request->refs))
 	{
-		if(error != ERROR_FILE_NOT_FOUND)
+		LocalFree((HLOCAL)request);
+	}
+}
+
+static BOOL _control_dispatch(const HWND hwnd, control_message_t *const message)
+{
+	DWORD_PTR result = 0U;
+	BOOL success = FALSE;
+	UINT i;
+	control_request_t *const request = (control_request_t*) LocalAlloc(LMEM_FIXED, sizeof(control_request_t));
+
+	if(!request)
+	{
+		return FALSE;
+	}
+
+	request->refs = 2L; /*released by both, the server thread and the window procedure*/
+	request->message.magic = message->magic;
+	request->message.version = message->version;
+	request->message.count = message->count;
+	for(i = 0U; i < message->count; ++i)
+	{
+		request->message.commands[i] = message->commands[i];
+	}
+
+	if(SendMessageTimeoutW(hwnd, WM_CONTROL, 0U, (LPARAM)request, SMTO_NORMAL, CONTROL_TIMEOUT, &result))
+	{
+		for(i = 0U; i < message->count; ++i)
 		{
-			TRACE("failed to open registry key for writing!");
-			return FALSE;
+			message->commands[i] = request->message.commands[i];
 		}
-		TRACE("registry key does not exist.");
-		return TRUE;
+		success = TRUE;
 	}
-
-	if((error = RegDeleteValueW(hkey, name)) != ERROR_SUCCESS)
+	else
 	{
-		if(error != ERROR_FILE_NOT_FOUND)
+		const DWORD error = GetLastError();
+		DEBUG("failed to dispatch the control request!");
+		if(error != ERROR_TIMEOUT)
 		{
-			RegCloseKey(hkey);
-			TRACE("failed to delete registry value!");
-			return FALSE;
+			_control_release(request); /*never delivered, so release the reference of the window procedure too*/
 		}
-		TRACE("registry value does not exist.");
 	}
 
-	RegCloseKey(hkey);
-	return TRUE;
+	_control_release(request);
+	return success;
 }
 
-// ==========================================================================
-// Service routines
-// ==========================================================================
-
-static BOOL find_running_service(const WCHAR *const name_prefix)
+static DWORD __stdcall _control_thread(LPVOID lpParameter)
 {
-	const int prefix_len = lstrlenW(name_prefix);
-	DWORD buffer_size = 0U, bytes_needed = 0U, services_returned = 0U, resume_handle = 0U;
-	BOOL result = FALSE, success = FALSE;
+	const HWND hwnd = (HWND) lpParameter;
+	pipe_security_t security;
+	SECURITY_ATTRIBUTES *attributes;
+	control_message_t message;
+	OVERLAPPED overlapped;
+	HANDLE event;
+
+	if(!(attributes = get_pipe_security(&security)))
+	{
+		DEBUG("failed to create the control pipe security descriptor!");
+		return 1U;
+	}
 
-	const SC_HANDLE scm = OpenSCManagerW(NULL, NULL, SC_MANAGER_ENUMERATE_SERVICE);
-	if(!scm)
+	if(!(event = CreateEventW(NULL, TRUE, FALSE, NULL)))
 	{
-		TRACE("failed to open service manager!");
-		return FALSE;
+		return 1U;
 	}
 
-	success = EnumServicesStatusExW(scm, SC_ENUM_PROCESS_INFO, SERVICE_WIN32, SERVICE_ACTIVE, NULL, 0U, &buffer_size, &services_returned, &resume_handle, NULL);
-	if((success || (GetLastError() == ERROR_MORE_DATA)) && (buffer_size > 0U))
+	while(WaitForSingleObject(g_control_stop, 0U) == WAIT_TIMEOUT)
 	{
-		ENUM_SERVICE_STATUS_PROCESS *buffer = (ENUM_SERVICE_STATUS_PROCESS*) LocalAlloc(LPTR, buffer_size);
-		if(buffer)
+		DWORD size, dummy;
+		const HANDLE pipe = CreateNamedPipeW(g_control_pipe, PIPE_ACCESS_DUPLEX | FILE_FLAG_FIRST_PIPE_INSTANCE | FILE_FLAG_OVERLAPPED, PIPE_TYPE_MESSAGE | PIPE_READMODE_MESSAGE | PIPE_WAIT | PIPE_REJECT_REMOTE_CLIENTS, 1U, sizeof(control_message_t), sizeof(control_message_t), 0U, attributes);
+		if(pipe == INVALID_HANDLE_VALUE)
 		{
-			for(;;)
+			DEBUG("failed to create the control pipe!");
+			break;
+		}
+		if(pipe_connect(pipe, pipe_overlapped(&overlapped, event), g_control_stop))
+		{
+			/*exactly one request per connection, so that an idle client can not block the others*/
+			if(pipe_wait(pipe, &overlapped, ReadFile(pipe, &message, sizeof(control_message_t), NULL, pipe_overlapped(&overlapped, event)), g_control_stop, CONTROL_TIMEOUT, &size))
 			{
-				success = EnumServicesStatusExW(scm, SC_ENUM_PROCESS_INFO, SERVICE_WIN32, SERVICE_ACTIVE, (BYTE*)buffer, buffer_size, &bytes_needed, &services_returned, &resume_handle, NULL);
-				if(success || (GetLastError() == ERROR_MORE_DATA))
+				if(!_control_validate(&message, size))
 				{
-					DWORD i;
-					for(i = 0U; i < services_returned; ++i)
-					{
-						if(!StrCmpNIW(buffer[i].lpServiceName, name_prefix, prefix_len))
-						{
-							if((buffer[i].lpServiceName[prefix_len] == L'\0') || (buffer[i].lpServiceName[prefix_len] == L'_'))
-							{
-								result = TRUE;
-								break;
-							}
-						}
-					}
-					if(!(success || result))
-					{
-						continue;
-					}
+					DEBUG("invalid control request, closing the connection!");
 				}
-				else
+				else if(_control_dispatch(hwnd, &message)
+					&& pipe_wait(pipe, &overlapped, WriteFile(pipe, &message, size, NULL, pipe_overlapped(&overlapped, event)), g_control_stop, CONTROL_TIMEOUT, &size))
 				{
-					TRACE("failed to enumerate active services!");
+					/*wait for the client to close its end, DisconnectNamedPipe() would discard an unread response*/
+					pipe_wait(pipe, &overlapped, ReadFile(pipe, &dummy, sizeof(DWORD), NULL, pipe_overlapped(&overlapped, event)), g_control_stop, CONTROL_TIMEOUT, &size);
 				}
-				break; /*completed*/
 			}
-			FREE(buffer);
-		}
-		else
-		{
-			TRACE("failed to allocate service status buffer!");
+			DisconnectNamedPipe(pipe);
 		}
-	}
-	else
-	{
-		TRACE("failed to determine service status size!");
+		CloseHandle(pipe);
 	}
 
-	CloseServiceHandle(scm);
-	return result;
+	CloseHandle(event);
+	return 0U;
 }
 
-// ==========================================================================
-// Message box routines
-// ==========================================================================
-
-typedef struct
+static BOOL control_start(const HWND hwnd)
 {
-	MSGBOXPARAMSW param;
-	WCHAR data[];
-}
-_msgbox_t;
+	get_pipe_name(g_control_pipe, _countof(g_control_pipe), L"control");
 
-static DWORD __stdcall _msgbox_thread(LPVOID lpParameter)
-{
-	if(lpParameter)
+	if(!(g_control_stop = CreateEventW(NULL, TRUE, FALSE, NULL)))
 	{
-		MessageBoxIndirectW(&(((_msgbox_t*)lpParameter)->param));
-		LocalFree((HLOCAL)lpParameter);
+		return FALSE;
 	}
-	return 1U;
-}
 
-static BOOL messagebox_async(const WCHAR *const text, const WCHAR *const caption, const DWORD style)
-{
-	int len_text;
-	_msgbox_t *buffer;
-
-	if(!(text && (len_text = lstrlenW(text)) > 0))
+	if(!(g_control_thread = CreateThread(NULL, 0U, _control_thread, (LPVOID)hwnd, 0U, NULL)))
 	{
+		CloseHandle(g_control_stop);
+		g_control_stop = NULL;
 		return FALSE;
 	}
 
-	if(g_msgbox_thread)
+	return TRUE;
+}
+
+static void control_stop(void)
+{
+	if(g_control_thread)
 	{
-		const DWORD status = WaitForSingleObject(g_msgbox_thread, 125U);
-		if((status != WAIT_OBJECT_0) && (status != WAIT_FAILED))
+		SetEvent(g_control_stop);
+		if(WaitForSingleObject(g_control_thread, 5000U) == WAIT_TIMEOUT)
 		{
-			return FALSE; /*message still showing*/
+			DEBUG("control thread failed to stop, terminating!");
+			TerminateThread(g_control_thread, 1U);
 		}
-		CloseHandle(g_msgbox_thread);
-		g_msgbox_thread = NULL;
+		CloseHandle(g_control_thread);
+		g_control_thread = NULL;
 	}
 
-	if(!(buffer = (_msgbox_t*) LocalAlloc(LPTR, sizeof(_msgbox_t) + ((len_text + (caption ? (lstrlenW(caption) + 1U) : 0U) + 1U) * sizeof(WCHAR)))))
+	if(g_control_stop)
 	{
-		return FALSE;
+		CloseHandle(g_control_stop);
+		g_control_stop = NULL;
 	}
+}
 
-	buffer->param.cbSize = sizeof(MSGBOXPARAMSW);
-	buffer->param.dwStyle = (style & (~MB_USERICON));
-	buffer->param.lpszText = buffer->data;
-	lstrcpyW((WCHAR*)buffer->param.lpszText, text);
+static void process_control(const HWND hwnd, control_request_t *const request)
+{
+	control_message_t *const message = &request->message;
+	UINT i;
 
-	if(caption)
-	{
-		buffer->param.lpszCaption = buffer->data + len_text + 1U;
-		lstrcpyW((WCHAR*)buffer->param.lpszCaption, caption);
-	}
-	
-	if(!(g_msgbox_thread = CreateThread(NULL, 0U, _msgbox_thread, buffer, 0U, NULL)))
+	for(i = 0U; i < message->count; ++i)
 	{
-		LocalFree((HLOCAL)buffer);
-		return FALSE;
+		control_command_t *const command = &message->commands[i];
+		command->status = CONTROL_OK;
+		switch(command->opcode)
+		{
+		case CONTROL_NOP:
+			break;
+		case CONTROL_CLEAR:
+			DEBUG("control: clear");
+			RECORD_EVENT(EVENT_COMMAND, 2U, 0U, 0U);
+			request_clear(hwnd, TRUE, 1U);
+			command->value = !g_clear.pending;
+			break;
+		case CONTROL_HALT:
+		case CONTROL_RESUME:
+			DEBUG2("control: halted=%s", BOOLIFY(command->opcode == CONTROL_HALT));
+			set_halted(hwnd, command->opcode == CONTROL_HALT);
+			break;
+		case CONTROL_SET_TIMEOUT:
+			DEBUG2("control: timeout=%u", command->value);
+			if((command->value >= 1000U) && (command->value <= 3600000U))
+			{
+				settings_t settings;
+				UINT j;
+				settings.timeout = command->value;
+				settings.textual_only = cfg_textual_only;
+				settings.sound_enabled = cfg_sound_enabled;
+				settings.retry_timeout = cfg_retry_timeout;
+				settings.sensitive_timeout = cfg_sensitive_timeout;
+				for(j = 0U; j < FORMAT_CLASS_COUNT; ++j)
+				{
+					settings.class_timeout[j] = cfg_class_timeout[j] ? command->value : 0U;
+				}
+				apply_settings(&settings);
+				if(!g_skip_current)
+				{
+					g_item_timeout = get_item_timeout();
+				}
+				update_timer(hwnd);
+			}
+			else
+			{
+				command->status = CONTROL_FAILED;
+			}
+			break;
+		case CONTROL_GET_STATE:
+			command->value = (cfg_halted ? STATE_HALTED : 0U) | (g_clear.pending ? STATE_CLEAR_PENDING : 0U) | ((g_scheduler.active & (1U << SLOT_DEADLINE)) ? STATE_ARMED : 0U) | (g_skip_current ? STATE_SKIPPED : 0U);
+			break;
+		case CONTROL_GET_REMAINING:
+			command->value = MAXDWORD;
+			if(g_scheduler.active & (1U << SLOT_DEADLINE))
+			{
+				const ULONGLONG tickCount = GetTickCount64(), deadline = g_tickCount + g_item_timeout;
+				command->value = (deadline > tickCount) ? (DWORD)(deadline - tickCount) : 0U;
+			}
+			break;
+		case CONTROL_GET_TIMEOUT:
+			command->value = g_item_timeout;
+			break;
+		case CONTROL_CLOSE:
+			DEBUG("control: close");
+			PostMessageW(hwnd, WM_CLOSE, 0, 0);
+			break;
+		default:
+			command->status = CONTROL_UNKNOWN;
+		}
 	}
 
-	return TRUE;
+	_control_release(request);
 }
 
-static BOOL stop_thread(const HANDLE thread)
+static UINT control_transact(control_message_t *const message)
 {
-	DWORD thread_id;
-
-	if(WaitForSingleObject(thread, 125U) != WAIT_TIMEOUT)
+	WCHAR pipe_name[64U];
+	HANDLE pipe = INVALID_HANDLE_VALUE;
+	DWORD pipe_mode = PIPE_READMODE_MESSAGE, request_size, size = 0U;
+	UINT retry;
+	BOOL success;
+
+	message->magic = CONTROL_MAGIC;
+	message->version = CONTROL_VERSION;
+	request_size = CONTROL_MESSAGE_SIZE(message->count);
+
+	get_pipe_name(pipe_name, _countof(pipe_name), L"control");
+	for(retry = 0U; retry < 3U; ++retry)
 	{
-		return TRUE; /*already terminated*/
+		if((pipe = CreateFileW(pipe_name, GENERIC_READ | GENERIC_WRITE, 0U, NULL, OPEN_EXISTING, 0U, NULL)) != INVALID_HANDLE_VALUE)
+		{
+			break;
+		}
+		if((GetLastError() != ERROR_PIPE_BUSY) || (!WaitNamedPipeW(pipe_name, CONTROL_TIMEOUT)))
+		{
+			break;
+		}
 	}
 
-	if(thread_id = GetThreadId(thread))
+	if(pipe == INVALID_HANDLE_VALUE)
 	{
-		PostThreadMessageW(thread_id, WM_QUIT, 0U, 0U);
+		DEBUG("failed to connect to the control pipe!");
+		return 1U;
 	}
 
-	if(WaitForSingleObject(thread, 5000U) == WAIT_TIMEOUT)
+	success = SetNamedPipeHandleState(pipe, &pipe_mode, NULL, NULL) && TransactNamedPipe(pipe, message, request_size, message, sizeof(control_message_t), &size, NULL);
+	CloseHandle(pipe);
+
+	if(!(success && (size == request_size) && _control_validate(message, size)))
 	{
-		DEBUG("message thread failed to stop, terminating!");
-		TerminateThread(thread, 1U);
-		return FALSE;
+		DEBUG("invalid control response!");
+		return 2U;
 	}
 
-	return TRUE;
+	return 0U;
 }
 
-// ==========================================================================
-// String helper routines
-// ==========================================================================
-
-static WCHAR *quote_string(const WCHAR *const text)
+static UINT control_client(control_message_t *const message)
 {
-	WCHAR *const buffer = (WCHAR*) LocalAlloc(LPTR, (lstrlenW(text) + 3U) * sizeof(WCHAR));
-	if(buffer)
+	WCHAR text[1024U];
+	UINT i, result, pos = 0U;
+	HANDLE output;
+
+	if(result = control_transact(message))
 	{
-		lstrcpyW(buffer, L"\"");
-		lstrcatW(buffer, text);
-		lstrcatW(buffer, L"\"");
-		return buffer;
+		SHOW_MESSAGE((result > 1U) ? L"Invalid response from the running instance!" : L"No running instance found!", MB_ICONWARNING);
+		return result;
 	}
-	
-	TRACE("failed to allocate string buffer!");
-	return NULL;
-}
 
-static WCHAR *concat_strings(const WCHAR *const text_1, const WCHAR *const text_2)
-{
-	WCHAR *const buffer = (WCHAR*) LocalAlloc(LPTR, (lstrlenW(text_1) + lstrlenW(text_2) + 1U) * sizeof(WCHAR));
-	if(buffer)
+	text[0U] = L'\0';
+	for(i = 0U; i < message->count; ++i)
 	{
-		lstrcpyW(buffer, text_1);
-		lstrcatW(buffer, text_2);
-		return buffer;
+		const control_command_t *const command = &message->commands[i];
+		if(command->status != CONTROL_OK)
+		{
+			DEBUG2("control command #%u failed: opcode=%u, status=%u", i, command->opcode, command->status);
+			result = 2U;
+			continue;
+		}
+		switch(command->opcode)
+		{
+		case CONTROL_GET_STATE:
+			pos += wnsprintfW(text + pos, _countof(text) - pos, L"halted=%s\r\npending=%s\r\narmed=%s\r\n", (command->value & STATE_HALTED) ? L"true" : L"false", (command->value & STATE_CLEAR_PENDING) ? L"true" : L"false", (command->value & STATE_ARMED) ? L"true" : L"false");
+			break;
+		case CONTROL_GET_REMAINING:
+			pos += (command->value != MAXDWORD) ? wnsprintfW(text + pos, _countof(text) - pos, L"remaining=%u\r\n", command->value) : wnsprintfW(text + pos, _countof(text) - pos, L"remaining=none\r\n");
+			break;
+		case CONTROL_GET_TIMEOUT:
+			pos += wnsprintfW(text + pos, _countof(text) - pos, L"timeout=%u\r\n", command->value);
+			break;
+		}
 	}
-	
-	TRACE("failed to allocate string buffer!");
-	return NULL;
-}
 
-static void output_formatted_string(const char *const format, ...)
-{
-	char buffer[128U];
-	va_list args;
-	va_start(args, format);
-	if(wvnsprintfA(buffer, 128U, format, args) > 0)
+	if(result)
 	{
-		buffer[127U] = '\0';
-		OutputDebugStringA(buffer);
+		SHOW_MESSAGE(L"The running instance rejected the request!", MB_ICONWARNING);
 	}
-	va_end(args);
+
+	if(text[0U])
+	{
+		output = GetStdHandle(STD_OUTPUT_HANDLE);
+		if(output && (output != INVALID_HANDLE_VALUE))
+		{
+			char buffer[1024U];
+			DWORD written;
+			const int len = WideCharToMultiByte(CP_ACP, 0U, text, -1, buffer, sizeof(buffer), NULL, NULL);
+			if(len > 1)
+			{
+				WriteFile(output, buffer, len - 1, &written, NULL);
+			}
+		}
+		else
+		{
+			SHOW_MESSAGE(text, MB_ICONINFORMATION);
+		}
+	}
+
+	return result;
 }
 
 // ==========================================================================
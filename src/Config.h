@@ -0,0 +1,141 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* ClearClipboard                                                                                */
+/* Copyright(c) 2019 LoRd_MuldeR <mulder2@gmx.de>                                                 */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * Parser of the configuration file. The "[ClearClipboard]" section of the decoded (UTF-16) text is split
+ * into a table of name/value pairs in place, which all subsequent lookups use. This follows the rules of
+ * GetPrivateProfileString(): names are case-insensitive, blanks around names and values as well as
+ * enclosing quotes are removed, lines starting with ';' are comments and the first occurrence wins.
+ * The includer supplies CONFIG_COMPARE(), with the semantics of lstrcmpiW(), so that the parser can be
+ * tested and benchmarked outside of ClearClipboard as well (see "tools/ConfigTest.c").
+ */
+
+#ifndef INC_CONFIG_H
+#define INC_CONFIG_H
+
+#ifndef CONFIG_COMPARE
+#error CONFIG_COMPARE() must be defined!
+#endif
+
+// Maximum number of entries in the section
+#define CONFIG_MAX_ENTRIES 64U
+
+typedef unsigned short config_char_t; /*UTF-16 code unit, same as WCHAR*/
+
+typedef struct
+{
+	unsigned int count;
+	struct { const config_char_t *name, *value; } entries[CONFIG_MAX_ENTRIES];
+	config_char_t text[1U]; /*variable size, the terminating NUL is already included*/
+}
+config_t;
+
+static config_char_t *_config_trim(config_char_t *text, config_char_t *end)
+{
+	while((text < end) && ((*text == 0x20) || (*text == 0x09)))
+	{
+		++text;
+	}
+	while((end > text) && ((end[-1] == 0x20) || (end[-1] == 0x09)))
+	{
+		--end;
+	}
+	if(((end - text) >= 2) && (((*text == 0x22) && (end[-1] == 0x22)) || ((*text == 0x27) && (end[-1] == 0x27))))
+	{
+		++text;
+		--end;
+	}
+	*end = 0x00;
+	return text;
+}
+
+static config_char_t *_config_find_char(config_char_t *text, const config_char_t c)
+{
+	for(; *text; ++text)
+	{
+		if(*text == c)
+		{
+			return text;
+		}
+	}
+	return 0;
+}
+
+static void config_parse(config_t *const config)
+{
+	static const config_char_t SECTION_NAME[] = { 'C', 'l', 'e', 'a', 'r', 'C', 'l', 'i', 'p', 'b', 'o', 'a', 'r', 'd', 0x00 };
+	config_char_t *line = config->text, *next, *end, *separator;
+	int in_section = 0;
+	unsigned int i;
+
+	for(; *line; line = next)
+	{
+		for(end = line; *end && (*end != 0x0D) && (*end != 0x0A); ++end);
+		next = *end ? (end + 1U) : end;
+		*end = 0x00;
+		while((*line == 0x20) || (*line == 0x09))
+		{
+			++line;
+		}
+		if(line[0U] == 0x5B) /*'['*/
+		{
+			config_char_t *const close = _config_find_char(line, 0x5D);
+			if(close)
+			{
+				*close = 0x00;
+				in_section = (!CONFIG_COMPARE(_config_trim(line + 1U, close), SECTION_NAME));
+			}
+			continue;
+		}
+		if((!in_section) || (line[0U] == 0x3B) || (!(separator = _config_find_char(line, 0x3D))) || (config->count >= CONFIG_MAX_ENTRIES))
+		{
+			continue;
+		}
+		config->entries[config->count].name = _config_trim(line, separator);
+		config->entries[config->count].value = _config_trim(separator + 1U, end);
+		for(i = 0U; i < config->count; ++i)
+		{
+			if(!CONFIG_COMPARE(config->entries[i].name, config->entries[config->count].name))
+			{
+				break; /*first occurrence wins*/
+			}
+		}
+		if((i >= config->count) && config->entries[config->count].name[0U])
+		{
+			++config->count;
+		}
+	}
+}
+
+// Returns the value of the given name, or NULL if it is not present
+static const config_char_t *config_find(const config_t *const config, const config_char_t *const name)
+{
+	unsigned int i;
+	for(i = 0U; i < config->count; ++i)
+	{
+		if(!CONFIG_COMPARE(config->entries[i].name, name))
+		{
+			return config->entries[i].value;
+		}
+	}
+	return 0;
+}
+
+#endif /*INC_CONFIG_H*/
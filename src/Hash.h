@@ -0,0 +1,86 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* ClearClipboard                                                                                */
+/* Copyright(c) 2019 LoRd_MuldeR <mulder2@gmx.de>                                                 */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * xxHash32 (seed 0) of a memory block, used to fingerprint the clipboard text. Plain 32-bit integer code;
+ * an SSE2 variant has to emulate the 32-bit multiply and was measured to be slower (see "tools/HashTest.c").
+ */
+
+#ifndef INC_HASH_H
+#define INC_HASH_H
+
+#include <stddef.h>
+
+// xxHash32 primes
+#define HASH_PRIME32_1 0x9E3779B1U
+#define HASH_PRIME32_2 0x85EBCA77U
+#define HASH_PRIME32_3 0xC2B2AE3DU
+#define HASH_PRIME32_4 0x27D4EB2FU
+#define HASH_PRIME32_5 0x165667B1U
+
+#define HASH_ROTL32(X,N) (((X) << (N)) | ((X) >> (32U - (N))))
+#define HASH_READ32(X) (*((const unsigned int*)(X))) /*little-endian, unaligned*/
+
+static unsigned int hash_xxh32(const unsigned char *const data, const size_t size)
+{
+	size_t pos = 0U;
+	unsigned int hash;
+
+	if(size >= 16U)
+	{
+		unsigned int lane[4U];
+		lane[0U] = HASH_PRIME32_1 + HASH_PRIME32_2;
+		lane[1U] = HASH_PRIME32_2;
+		lane[2U] = 0U;
+		lane[3U] = 0U - HASH_PRIME32_1;
+		for(; pos + 16U <= size; pos += 16U)
+		{
+			lane[0U] = HASH_ROTL32(lane[0U] + (HASH_READ32(data + pos      ) * HASH_PRIME32_2), 13U) * HASH_PRIME32_1;
+			lane[1U] = HASH_ROTL32(lane[1U] + (HASH_READ32(data + pos +  4U) * HASH_PRIME32_2), 13U) * HASH_PRIME32_1;
+			lane[2U] = HASH_ROTL32(lane[2U] + (HASH_READ32(data + pos +  8U) * HASH_PRIME32_2), 13U) * HASH_PRIME32_1;
+			lane[3U] = HASH_ROTL32(lane[3U] + (HASH_READ32(data + pos + 12U) * HASH_PRIME32_2), 13U) * HASH_PRIME32_1;
+		}
+		hash = HASH_ROTL32(lane[0U], 1U) + HASH_ROTL32(lane[1U], 7U) + HASH_ROTL32(lane[2U], 12U) + HASH_ROTL32(lane[3U], 18U);
+	}
+	else
+	{
+		hash = HASH_PRIME32_5;
+	}
+
+	hash += (unsigned int)size;
+
+	for(; pos + 4U <= size; pos += 4U)
+	{
+		hash = HASH_ROTL32(hash + (HASH_READ32(data + pos) * HASH_PRIME32_3), 17U) * HASH_PRIME32_4;
+	}
+	for(; pos < size; ++pos)
+	{
+		hash = HASH_ROTL32(hash + (data[pos] * HASH_PRIME32_5), 11U) * HASH_PRIME32_1;
+	}
+
+	hash ^= hash >> 15;
+	hash *= HASH_PRIME32_2;
+	hash ^= hash >> 13;
+	hash *= HASH_PRIME32_3;
+	hash ^= hash >> 16;
+	return hash;
+}
+
+#endif /*INC_HASH_H*/
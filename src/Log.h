@@ -0,0 +1,263 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* ClearClipboard                                                                                */
+/* Copyright(c) 2019 LoRd_MuldeR <mulder2@gmx.de>                                                 */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * Bounded lock-free ring of log records (Vyukov-style sequence numbers per slot), plus the code that stores
+ * and formats the records. The includer supplies the atomic operations LOG_CAS(), LOG_XCHG() and LOG_INC(),
+ * with the semantics of the Win32 Interlocked functions, and LOG_SNPRINTF(), with the semantics of
+ * wnsprintfA(), so that the ring can be driven outside of ClearClipboard as well (see "tools/LogTest.c").
+ *
+ * Arguments are copied by type when the record is stored: "%s", "%S" and "%p" take a pointer, all other
+ * conversions take an int-sized value. Only the pointer is copied, so strings must be static data!
+ */
+
+#ifndef INC_LOG_H
+#define INC_LOG_H
+
+#include <stddef.h>
+#include <stdarg.h>
+
+#if !(defined(LOG_CAS) && defined(LOG_XCHG) && defined(LOG_INC) && defined(LOG_SNPRINTF))
+#error LOG_CAS(), LOG_XCHG(), LOG_INC() and LOG_SNPRINTF() must be defined!
+#endif
+
+// Number of records in the ring (power of two)
+#define LOG_RING_SIZE 256U
+
+// Maximum number of arguments per record
+#define LOG_MAX_ARGS 4U
+
+typedef struct
+{
+	volatile long sequence;
+	unsigned int timestamp;
+	const char *format; /*NULL for binary trace events*/
+	unsigned int argc;
+	size_t args[LOG_MAX_ARGS];
+}
+log_record_t;
+
+typedef struct
+{
+	log_record_t slots[LOG_RING_SIZE];
+	volatile long head, dropped, waiting;
+}
+log_ring_t;
+
+static void log_ring_init(log_ring_t *const ring)
+{
+	long i;
+	for(i = 0L; i < (long)LOG_RING_SIZE; ++i)
+	{
+		ring->slots[i].sequence = i;
+	}
+	ring->head = ring->dropped = ring->waiting = 0L;
+}
+
+// Returns a free record, or NULL if the ring is full
+static log_record_t *log_ring_acquire(log_ring_t *const ring, long *const pos)
+{
+	log_record_t *record;
+	*pos = ring->head;
+
+	for(;;)
+	{
+		long diff;
+		record = &ring->slots[(*pos) & (LOG_RING_SIZE - 1U)];
+		if(!(diff = record->sequence - (*pos)))
+		{
+			if(LOG_CAS(&ring->head, (*pos) + 1L, *pos) == (*pos))
+			{
+				return record; /*slot acquired*/
+			}
+		}
+		else if(diff < 0L)
+		{
+			LOG_INC(&ring->dropped);
+			return NULL; /*ring is full*/
+		}
+		*pos = ring->head;
+	}
+}
+
+// Publishes the record; returns non-zero, if the consumer is waiting and needs to be woken up
+static int log_ring_commit(log_ring_t *const ring, log_record_t *const record, const long pos)
+{
+	LOG_XCHG(&record->sequence, pos + 1L);
+	return (LOG_XCHG(&ring->waiting, 0L) != 0L);
+}
+
+// Returns the record at position "tail", if it has been published
+static log_record_t *log_ring_peek(log_ring_t *const ring, const long tail)
+{
+	log_record_t *const record = &ring->slots[tail & (LOG_RING_SIZE - 1U)];
+	return (record->sequence == (tail + 1L)) ? record : NULL;
+}
+
+static void log_ring_release(log_record_t *const record, const long tail)
+{
+	LOG_XCHG(&record->sequence, tail + (long)LOG_RING_SIZE);
+}
+
+static int _log_is_modifier(const char c)
+{
+	return ((c >= '0') && (c <= '9')) || (c == '-') || (c == '+') || (c == ' ') || (c == '#') || (c == '.') || (c == 'l') || (c == 'h') || (c == 'I');
+}
+
+static int _log_is_pointer(const char c)
+{
+	return (c == 's') || (c == 'S') || (c == 'p');
+}
+
+// Returns the conversion character of the specification at "format" (which points to a '%')
+static char _log_conversion(const char *const format, unsigned int *const length)
+{
+	unsigned int i = 1U;
+	while(_log_is_modifier(format[i]))
+	{
+		++i;
+	}
+	*length = format[i] ? (i + 1U) : i;
+	return format[i];
+}
+
+// Returns the number of arguments; bit N of "pointers" is set, if argument N is a pointer
+static unsigned int log_parse_format(const char *format, unsigned int *const pointers)
+{
+	unsigned int argc = 0U, length;
+	char conversion;
+
+	*pointers = 0U;
+	while(*format)
+	{
+		if(*(format++) != '%')
+		{
+			continue;
+		}
+		conversion = _log_conversion(format - 1U, &length);
+		format += length - 1U;
+		if(conversion && (conversion != '%'))
+		{
+			if(_log_is_pointer(conversion) && (argc < 32U))
+			{
+				*pointers |= 1U << argc;
+			}
+			++argc;
+		}
+	}
+
+	return argc;
+}
+
+// Stores the format and its arguments in the record; returns zero, if there are too many arguments
+static int log_record_store(log_record_t *const record, const char *const format, va_list args)
+{
+	unsigned int i, pointers;
+
+	record->format = format;
+	if((record->argc = log_parse_format(format, &pointers)) > LOG_MAX_ARGS)
+	{
+		record->argc = 0U;
+		return 0;
+	}
+
+	for(i = 0U; i < LOG_MAX_ARGS; ++i)
+	{
+		if(i >= record->argc)
+		{
+			record->args[i] = 0U;
+		}
+		else if(pointers & (1U << i))
+		{
+			record->args[i] = (size_t) va_arg(args, const void*);
+		}
+		else
+		{
+			record->args[i] = va_arg(args, unsigned int);
+		}
+	}
+
+	return 1;
+}
+
+/*
+ * Formats the record into the buffer, one conversion at a time, so that every argument is passed with its
+ * original type. Lines that do not fit are cut off and end with "...\n". Returns the length of the line.
+ */
+static int log_format_line(char *const buffer, const int size, const log_record_t *const record)
+{
+	const char *format = record->format;
+	unsigned int argc = 0U, length, i;
+	char spec[16U], conversion;
+	int pos = 0;
+
+	while(*format && (pos < size - 1))
+	{
+		if(*format != '%')
+		{
+			buffer[pos++] = *(format++);
+			continue;
+		}
+		conversion = _log_conversion(format, &length);
+		if((!conversion) || (conversion == '%'))
+		{
+			buffer[pos++] = '%';
+			format += length;
+			continue;
+		}
+		if((length < sizeof(spec)) && (argc < record->argc))
+		{
+			for(i = 0U; i < length; ++i)
+			{
+				spec[i] = format[i];
+			}
+			spec[length] = '\0';
+			buffer[pos] = '\0';
+			if(_log_is_pointer(conversion))
+			{
+				LOG_SNPRINTF(buffer + pos, size - pos, spec, (const void*) record->args[argc]);
+			}
+			else
+			{
+				LOG_SNPRINTF(buffer + pos, size - pos, spec, (unsigned int) record->args[argc]);
+			}
+			while((pos < size - 1) && buffer[pos])
+			{
+				++pos; /*the return value of wnsprintfA() is unreliable on truncation*/
+			}
+		}
+		format += length;
+		++argc;
+	}
+
+	if((*format) && (size > 4))
+	{
+		for(i = 0U; i < 4U; ++i)
+		{
+			buffer[size - 5 + (int)i] = "...\n"[i];
+		}
+		pos = size - 1;
+	}
+
+	buffer[pos] = '\0';
+	return pos;
+}
+
+#endif /*INC_LOG_H*/
@@ -0,0 +1,125 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* ClearClipboard                                                                                */
+/* Copyright(c) 2019 LoRd_MuldeR <mulder2@gmx.de>                                                 */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * Well-known clipboard managers, detected by the executable name of their process. The names are kept in
+ * a small hash set (FNV-1a over the ASCII-lowercased name, open addressing), so that each process of a
+ * snapshot costs one hash and, usually, no string comparison. The code only depends on the C compiler,
+ * so it can be tested and benchmarked outside of ClearClipboard as well (see "tools/ManagerTest.c").
+ */
+
+#ifndef INC_MANAGERS_H
+#define INC_MANAGERS_H
+
+// Size of the hash set (power of two, more than twice the number of managers)
+#define MANAGER_TABLE_SIZE 32U
+
+#define MANAGER_LOWER(X) ((((X) >= 0x41) && ((X) <= 0x5A)) ? ((X) + 0x20U) : (X))
+
+// Known clipboard managers (ASCII names)
+static const struct
+{
+	const char *exe_name;
+	const char *display_name;
+}
+CLIPBOARD_MANAGERS[12U] =
+{
+	{ "1Clipboard.exe",      "1Clipboard"      },
+	{ "ArsClip.exe",         "ArsClip"         },
+	{ "CLCL.exe",            "CLCL"            },
+	{ "ClipAngel.exe",       "ClipAngel"       },
+	{ "ClipboardFusion.exe", "ClipboardFusion" },
+	{ "ClipClip.exe",        "ClipClip"        },
+	{ "Clipdiary.exe",       "Clipdiary"       },
+	{ "Clipjump.exe",        "Clipjump"        },
+	{ "ClipMate.exe",        "ClipMate"        },
+	{ "ClipX.exe",           "ClipX"           },
+	{ "CopyQ.exe",           "CopyQ"           },
+	{ "Ditto.exe",           "Ditto"           }
+};
+
+typedef struct
+{
+	unsigned char slots[MANAGER_TABLE_SIZE]; /*index + 1, or zero*/
+}
+manager_table_t;
+
+static unsigned int _manager_hash(const unsigned short *name)
+{
+	unsigned int hash = 0x811C9DC5U;
+	for(; *name; ++name)
+	{
+		hash = (hash ^ MANAGER_LOWER((unsigned int)(*name))) * 0x01000193U;
+	}
+	return hash;
+}
+
+static unsigned int _manager_hash_ascii(const char *name)
+{
+	unsigned int hash = 0x811C9DC5U;
+	for(; *name; ++name)
+	{
+		hash = (hash ^ MANAGER_LOWER((unsigned int)(unsigned char)(*name))) * 0x01000193U;
+	}
+	return hash;
+}
+
+// Returns non-zero, if the (UTF-16) name equals the ASCII name, ignoring the case
+static int manager_compare(const unsigned short *name, const char *ascii)
+{
+	for(; *name && *ascii; ++name, ++ascii)
+	{
+		if(MANAGER_LOWER((unsigned int)(*name)) != MANAGER_LOWER((unsigned int)(unsigned char)(*ascii)))
+		{
+			return 0;
+		}
+	}
+	return (!(*name)) && (!(*ascii));
+}
+
+static void manager_table_init(manager_table_t *const table)
+{
+	unsigned int i, slot;
+	for(slot = 0U; slot < MANAGER_TABLE_SIZE; ++slot)
+	{
+		table->slots[slot] = 0U;
+	}
+	for(i = 0U; i < sizeof(CLIPBOARD_MANAGERS) / sizeof(CLIPBOARD_MANAGERS[0U]); ++i)
+	{
+		for(slot = _manager_hash_ascii(CLIPBOARD_MANAGERS[i].exe_name) & (MANAGER_TABLE_SIZE - 1U); table->slots[slot]; slot = (slot + 1U) & (MANAGER_TABLE_SIZE - 1U));
+		table->slots[slot] = (unsigned char)(i + 1U);
+	}
+}
+
+// Returns the index of the clipboard manager with the given executable name, or -1
+static int manager_find(const manager_table_t *const table, const unsigned short *const exe_name)
+{
+	unsigned int slot;
+	for(slot = _manager_hash(exe_name) & (MANAGER_TABLE_SIZE - 1U); table->slots[slot]; slot = (slot + 1U) & (MANAGER_TABLE_SIZE - 1U))
+	{
+		if(manager_compare(exe_name, CLIPBOARD_MANAGERS[table->slots[slot] - 1U].exe_name))
+		{
+			return table->slots[slot] - 1;
+		}
+	}
+	return -1;
+}
+
+#endif /*INC_MANAGERS_H*/
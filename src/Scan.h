@@ -0,0 +1,439 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* ClearClipboard                                                                                */
+/* Copyright(c) 2019 LoRd_MuldeR <mulder2@gmx.de>                                                 */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * Detection of sensitive text (card numbers, IBANs, API keys and password-like tokens). These functions
+ * are free of side effects and only depend on the C compiler, so they can be tested and benchmarked
+ * outside of ClearClipboard as well (see "tools/ScanTest.c").
+ */
+
+#ifndef INC_SCAN_H
+#define INC_SCAN_H
+
+#include <stddef.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#ifdef HAVE_SSE2
+#include <emmintrin.h>
+#endif
+
+// Minimum length of a password-like token
+#define SCAN_ENTROPY_MIN_LENGTH 12U
+
+// Entropy shortfall that is still accepted, in 1/256 bit per character (0.3 bit)
+#define SCAN_ENTROPY_TOLERANCE 77
+
+// Bias of the plug-in entropy estimate, in 1/256 bit (256 / (2 ln 2))
+#define SCAN_ENTROPY_BIAS 185U
+
+// Detection results
+#define SCAN_NONE    0U
+#define SCAN_CARD    1U
+#define SCAN_IBAN    2U
+#define SCAN_KEY     3U
+#define SCAN_ENTROPY 4U
+
+#define SCAN_IS_DIGIT(X) (((X) >= 0x30) && ((X) <= 0x39))
+#define SCAN_IS_UPPER(X) (((X) >= 0x41) && ((X) <= 0x5A))
+#define SCAN_IS_LOWER(X) (((X) >= 0x61) && ((X) <= 0x7A))
+
+typedef unsigned short scan_char_t; /*UTF-16 code unit, same as WCHAR*/
+
+typedef struct
+{
+	scan_char_t group[35U];
+	unsigned int length;
+	size_t last_end;
+}
+scan_state_t;
+
+// Well-known API key prefixes
+static const struct
+{
+	const char *prefix;
+	unsigned int min_length;
+}
+SCAN_KEY_PREFIXES[18U] =
+{
+	{ "AIza",        39U },
+	{ "AKIA",        20U },
+	{ "ASIA",        20U },
+	{ "ghp_",        40U },
+	{ "gho_",        40U },
+	{ "ghr_",        40U },
+	{ "ghs_",        40U },
+	{ "ghu_",        40U },
+	{ "github_pat_", 40U },
+	{ "glpat-",      26U },
+	{ "npm_",        40U },
+	{ "rk_live_",    24U },
+	{ "sk-",         24U },
+	{ "sk_live_",    24U },
+	{ "xoxa-",       24U },
+	{ "xoxb-",       24U },
+	{ "xoxp-",       24U },
+	{ "xoxr-",       24U }
+};
+
+// Names of the detection results (static strings)
+static const char *const SCAN_RESULT_NAMES[5U] =
+{
+	"none", "card number", "iban", "api key", "high-entropy token"
+};
+
+static unsigned int _scan_msb(const unsigned int value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanReverse(&index, value);
+	return (unsigned int) index;
+#else
+	return 31U - (unsigned int) __builtin_clz(value);
+#endif
+}
+
+#ifdef HAVE_SSE2
+static unsigned int _scan_lsb(const unsigned int value)
+{
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward(&index, value);
+	return (unsigned int) index;
+#else
+	return (unsigned int) __builtin_ctz(value);
+#endif
+}
+#endif //HAVE_SSE2
+
+static void _scan_zero(void *const buffer, size_t size)
+{
+	volatile unsigned char *ptr = (volatile unsigned char*) buffer;
+	while(size--)
+	{
+		*ptr++ = 0U; /*no memset(), as the release build does not link the CRT*/
+	}
+}
+
+static int scan_check_key_prefix(const scan_char_t *const token, const size_t len)
+{
+	size_t i;
+	for(i = 0U; i < sizeof(SCAN_KEY_PREFIXES) / sizeof(SCAN_KEY_PREFIXES[0U]); ++i)
+	{
+		if(len >= SCAN_KEY_PREFIXES[i].min_length)
+		{
+			const char *prefix = SCAN_KEY_PREFIXES[i].prefix;
+			const scan_char_t *ptr = token;
+			while(*prefix && (*ptr == (scan_char_t)(unsigned char)(*prefix)))
+			{
+				++prefix; ++ptr;
+			}
+			if(!(*prefix))
+			{
+				return 1;
+			}
+		}
+	}
+	return 0;
+}
+
+static int scan_check_luhn(const scan_char_t *const digits, const unsigned int len)
+{
+	unsigned int i, sum = 0U;
+	for(i = 0U; i < len; ++i)
+	{
+		unsigned int value = digits[len - i - 1U] - 0x30U;
+		if(i & 1U)
+		{
+			value = (value > 4U) ? ((2U * value) - 9U) : (2U * value);
+		}
+		sum += value;
+	}
+	return ((sum % 10U) == 0U);
+}
+
+static int scan_check_iban(const scan_char_t *const iban, const unsigned int len)
+{
+	unsigned int i, remainder = 0U;
+	for(i = 0U; i < len; ++i)
+	{
+		const scan_char_t c = iban[(i + 4U) % len];
+		if(SCAN_IS_DIGIT(c))
+		{
+			remainder = ((remainder * 10U) + (c - 0x30U)) % 97U;
+		}
+		else
+		{
+			remainder = ((remainder * 100U) + (c - 0x41U + 10U)) % 97U;
+		}
+	}
+	return (remainder == 1U);
+}
+
+static unsigned int scan_check_number_group(scan_state_t *const state, const scan_char_t *const token, size_t len, const int adjacent)
+{
+	size_t i;
+	unsigned int digits = 0U;
+
+	while((len > 1U) && ((token[len - 1U] == 0x2C) || (token[len - 1U] == 0x2E) || (token[len - 1U] == 0x3B) || (token[len - 1U] == 0x29)))
+	{
+		--len; /*trailing punctuation, e.g. "1111,"*/
+	}
+
+	for(i = 0U; i < len; ++i)
+	{
+		if(!(SCAN_IS_DIGIT(token[i]) || SCAN_IS_UPPER(token[i]) || (token[i] == 0x2D)))
+		{
+			state->length = 0U;
+			return SCAN_NONE; /*not a number group*/
+		}
+	}
+
+	if(!(adjacent && (len <= 6U)))
+	{
+		state->length = 0U;
+	}
+
+	for(i = 0U; i < len; ++i)
+	{
+		if(token[i] != 0x2D)
+		{
+			if(state->length >= (sizeof(state->group) / sizeof(state->group[0U])) - 1U)
+			{
+				state->length = 0U;
+				return SCAN_NONE; /*too long*/
+			}
+			state->group[state->length++] = token[i];
+		}
+	}
+
+	for(i = 0U; i < state->length; ++i)
+	{
+		if(SCAN_IS_DIGIT(state->group[i]))
+		{
+			++digits;
+		}
+	}
+
+	if((digits == state->length) && (state->length >= 13U) && (state->length <= 19U))
+	{
+		if((state->group[0U] >= 0x32) && (state->group[0U] <= 0x36) && scan_check_luhn(state->group, state->length))
+		{
+			return SCAN_CARD;
+		}
+	}
+	else if((state->length >= 15U) && SCAN_IS_UPPER(state->group[0U]) && SCAN_IS_UPPER(state->group[1U]) && SCAN_IS_DIGIT(state->group[2U]) && SCAN_IS_DIGIT(state->group[3U]))
+	{
+		if(scan_check_iban(state->group, state->length))
+		{
+			return SCAN_IBAN;
+		}
+	}
+
+	return SCAN_NONE;
+}
+
+static unsigned int _scan_log2_fixed(const unsigned int value) /*log2(value) in 1/256 units, for 0 < value < 65536*/
+{
+	const unsigned int index = _scan_msb(value);
+	unsigned int mantissa, result, bit;
+
+	result = index << 8U;
+	mantissa = value << (15U - index);
+	for(bit = 0x80U; bit; bit >>= 1U)
+	{
+		mantissa = (mantissa * mantissa) >> 15U;
+		if(mantissa >= 0x10000U)
+		{
+			mantissa >>= 1U;
+			result |= bit;
+		}
+	}
+
+	return result;
+}
+
+/*
+ * Estimates the Shannon entropy of the token (in 1/256 bit) from its character counts and compares it to
+ * the entropy that a random string of the same length, drawn from the character classes that occur in the
+ * token, is expected to have (a plug-in estimate is biased low, roughly by (k-1)/(2n ln 2) bit for n draws
+ * from k symbols). Words, identifiers and dates have repeated characters, and fall short of that.
+ */
+static int scan_check_entropy(const scan_char_t *const token, const size_t len)
+{
+	unsigned char counts[0x60U];
+	size_t i;
+	unsigned int classes = 0U, alphabet;
+	int bits, expected, alternative;
+
+	if(len < SCAN_ENTROPY_MIN_LENGTH)
+	{
+		return 0;
+	}
+
+	_scan_zero(counts, sizeof(counts));
+	for(i = 0U; i < len; ++i)
+	{
+		const scan_char_t c = token[i];
+		if((c < 0x21) || (c > 0x7E) || (c == 0x2F) || (c == 0x5C))
+		{
+			return 0; /*not a password-like token*/
+		}
+		classes |= SCAN_IS_DIGIT(c) ? 1U : (SCAN_IS_UPPER(c) ? 2U : (SCAN_IS_LOWER(c) ? 4U : 8U));
+		++counts[c - 0x20];
+	}
+
+	if(((classes & 1U) + ((classes >> 1U) & 1U) + ((classes >> 2U) & 1U) + (classes >> 3U)) < 3U)
+	{
+		return 0;
+	}
+
+	bits = (int)(len * _scan_log2_fixed((unsigned int)len));
+	for(i = 0U; i < 0x60U; ++i)
+	{
+		if(counts[i] > 1U)
+		{
+			bits -= (int)(counts[i] * _scan_log2_fixed(counts[i]));
+		}
+	}
+
+	alphabet = ((classes & 1U) ? 10U : 0U) + ((classes & 2U) ? 26U : 0U) + ((classes & 4U) ? 26U : 0U) + ((classes & 8U) ? 32U : 0U);
+	expected = (int)_scan_log2_fixed((unsigned int)len) - (int)(((len - 1U) * SCAN_ENTROPY_BIAS) / alphabet);
+	alternative = (int)_scan_log2_fixed(alphabet) - (int)(((alphabet - 1U) * SCAN_ENTROPY_BIAS) / len);
+
+	return bits >= ((int)len * (((expected > alternative) ? expected : alternative) - SCAN_ENTROPY_TOLERANCE));
+}
+
+static unsigned int scan_check_token(scan_state_t *const state, const scan_char_t *const text, const size_t start, const size_t end)
+{
+	const size_t len = end - start;
+	const int adjacent = (start == state->last_end + 1U) && (text[state->last_end] == 0x20);
+	unsigned int result;
+
+	state->last_end = end;
+
+	if((len < 10U) && (!state->length) && (!(SCAN_IS_DIGIT(text[start]) || SCAN_IS_UPPER(text[start]))))
+	{
+		return SCAN_NONE; /*fast path for short words*/
+	}
+
+	if((result = scan_check_number_group(state, text + start, len, adjacent)) != SCAN_NONE)
+	{
+		return result;
+	}
+
+	if((len >= 10U) && (len <= 128U))
+	{
+		if(scan_check_key_prefix(text + start, len))
+		{
+			return SCAN_KEY;
+		}
+		if(scan_check_entropy(text + start, len))
+		{
+			return SCAN_ENTROPY;
+		}
+	}
+
+	return SCAN_NONE;
+}
+
+// Scans up to "len" characters of the text (or up to the terminating NUL) and returns the first detection
+static unsigned int scan_sensitive_text(const scan_char_t *const text, const size_t len, const int use_sse2)
+{
+	scan_state_t state;
+	size_t pos = 0U, limit = len, token_start = 0U;
+	int in_token = 0;
+	unsigned int result;
+
+	_scan_zero(&state, sizeof(scan_state_t));
+
+#ifdef HAVE_SSE2
+	if(use_sse2)
+	{
+		const __m128i space = _mm_set1_epi16(0x20), zero = _mm_setzero_si128();
+		while(pos + 8U <= limit)
+		{
+			const __m128i data = _mm_loadu_si128((const __m128i*)(text + pos));
+			unsigned int mask = (unsigned int) _mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(_mm_subs_epu16(data, space), zero), zero));
+			const unsigned int null_mask = (unsigned int) _mm_movemask_epi8(_mm_packs_epi16(_mm_cmpeq_epi16(data, zero), zero));
+			unsigned int transitions, index;
+			if(null_mask)
+			{
+				limit = pos + _scan_lsb(null_mask);
+				break; /*terminated*/
+			}
+			transitions = (mask ^ ((mask << 1U) | (in_token ? 0U : 1U))) & 0xFFU;
+			while(transitions)
+			{
+				index = _scan_lsb(transitions);
+				transitions &= transitions - 1U;
+				if(in_token)
+				{
+					if((result = scan_check_token(&state, text, token_start, pos + index)) != SCAN_NONE)
+					{
+						return result;
+					}
+				}
+				else
+				{
+					token_start = pos + index;
+				}
+				in_token = !in_token;
+			}
+			pos += 8U;
+		}
+	}
+#else
+	(void) use_sse2;
+#endif //HAVE_SSE2
+
+	for(; pos < limit; ++pos)
+	{
+		if(text[pos] <= 0x20)
+		{
+			if(!text[pos])
+			{
+				break; /*terminated*/
+			}
+			if(in_token)
+			{
+				if((result = scan_check_token(&state, text, token_start, pos)) != SCAN_NONE)
+				{
+					return result;
+				}
+				in_token = 0;
+			}
+		}
+		else if(!in_token)
+		{
+			token_start = pos;
+			in_token = 1;
+		}
+	}
+
+	if(in_token)
+	{
+		return scan_check_token(&state, text, token_start, pos);
+	}
+
+	return SCAN_NONE;
+}
+
+#endif /*INC_SCAN_H*/
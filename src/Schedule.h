@@ -0,0 +1,66 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* ClearClipboard                                                                                */
+/* Copyright(c) 2019 LoRd_MuldeR <mulder2@gmx.de>                                                 */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * Deadline arithmetic of the clear timer. These functions are free of side effects and do not read the
+ * clock, so they can be driven by a simulated clock as well (see "tools/TraceDecode.c").
+ */
+
+#ifndef INC_SCHEDULE_H
+#define INC_SCHEDULE_H
+
+// Minimum timer delay (equals USER_TIMER_MINIMUM)
+#define SCHEDULE_MIN_DELAY 0x0000000AU
+
+// Fraction of the timeout to wait before re-checking an overdue item
+#define SCHEDULE_OVERDUE_DIVISOR 30U
+
+typedef unsigned long long schedule_tick_t;
+
+// Returns non-zero, if the item copied at "start" has expired at time "now"
+static int schedule_expired(const schedule_tick_t now, const schedule_tick_t start, const unsigned int timeout)
+{
+	return timeout && (now >= start) && ((now - start) >= timeout);
+}
+
+// Returns the delay until the timer needs to fire next, or zero if no timer is required
+static unsigned int schedule_delay(const schedule_tick_t now, const schedule_tick_t start, const unsigned int timeout)
+{
+	const schedule_tick_t deadline = start + timeout;
+	unsigned int delay;
+
+	if(!timeout)
+	{
+		return 0U; /*never expires*/
+	}
+
+	if(deadline > now)
+	{
+		delay = ((deadline - now) < timeout) ? ((unsigned int)(deadline - now)) : timeout;
+	}
+	else
+	{
+		delay = timeout / SCHEDULE_OVERDUE_DIVISOR; /*overdue, retry later*/
+	}
+
+	return (delay > SCHEDULE_MIN_DELAY) ? delay : SCHEDULE_MIN_DELAY;
+}
+
+#endif /*INC_SCHEDULE_H*/
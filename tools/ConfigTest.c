@@ -0,0 +1,287 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* ClearClipboard - Configuration Test                                                            */
+/* Copyright(c) 2019 LoRd_MuldeR <mulder2@gmx.de>                                                 */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * Checks the configuration parser (see "src/Config.h") and measures the cost of loading the settings.
+ * This is a portable C program without any dependencies; build it with any C compiler, e.g. "cl ConfigTest.c".
+ *
+ * The program checks the profile rules on fixed cases. Then it writes a typical configuration file and
+ * compares two ways of looking up all the settings that ClearClipboard reads at startup: reading and parsing
+ * the file once, and reading and parsing it again for every setting, which is what each call of the profile
+ * API (GetPrivateProfileString) amounts to. The profile API itself is Windows-only and is not measured here,
+ * so the second figure is a lower bound for it. The exit code is non-zero, if any check has failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static int compare_names(const unsigned short *a, const unsigned short *b);
+#define CONFIG_COMPARE compare_names
+
+#include "../src/Config.h"
+
+// Const
+#define FILE_NAME "ConfigTest.tmp"
+#define BENCH_SECONDS 1.0
+
+// Check macro
+#define CHECK(X) do \
+{ \
+	if(!(X)) \
+	{ \
+		fprintf(stderr, "Check failed: %s (line %d)\n", #X, __LINE__); \
+		++g_failed; \
+	} \
+} \
+while(0)
+
+static unsigned long g_failed = 0UL;
+
+// Settings read at startup (see load_settings() and the other get_config_value() calls)
+static const char *const NAMES[] =
+{
+	"Timeout", "TextOnly", "Sound", "RetryTimeout", "TimeoutText", "TimeoutRichText", "TimeoutImage", "TimeoutFiles",
+	"TimeoutOther", "TimeoutSensitive", "Halted", "Hotkey", "DisableWarningMessages", "HideNotificationIcon",
+	"WarningStyle", "IgnoreRecopy", "ClearOnLock", "ClearOnSuspend", "MetricsPipe", "com.muldersoft.clear_clipboard"
+};
+
+static const char *const SAMPLE =
+	"; ClearClipboard configuration\r\n"
+	"[ClearClipboard]\r\n"
+	"; clear timeout, in milliseconds\r\n"
+	"Timeout=30000\r\n"
+	"TextOnly=0\r\n"
+	"TimeoutText=30000\r\n"
+	"TimeoutRichText=30000\r\n"
+	"TimeoutImage=60000\r\n"
+	"TimeoutFiles=0\r\n"
+	"TimeoutSensitive=10000\r\n"
+	"Sound=1\r\n"
+	"RetryTimeout=1000\r\n"
+	"Halted=0\r\n"
+	"Hotkey=0x258\r\n"
+	"DisableWarningMessages=0\r\n"
+	"HideNotificationIcon=0\r\n"
+	"WarningStyle=1\r\n"
+	"IgnoreRecopy=1\r\n"
+	"ClearOnLock=1\r\n"
+	"ClearOnSuspend=1\r\n"
+	"MetricsPipe=0\r\n"
+	"com.muldersoft.clear_clipboard=1\r\n"
+	"\r\n"
+	"[Other]\r\n"
+	"Timeout=1\r\n";
+
+// ==========================================================================
+// Helper functions
+// ==========================================================================
+
+static int compare_names(const unsigned short *a, const unsigned short *b)
+{
+	for(;;)
+	{
+		const unsigned short x = ((*a >= 'A') && (*a <= 'Z')) ? (*a + 0x20) : *a;
+		const unsigned short y = ((*b >= 'A') && (*b <= 'Z')) ? (*b + 0x20) : *b;
+		if((x != y) || (!x))
+		{
+			return (int)x - (int)y;
+		}
+		++a; ++b;
+	}
+}
+
+static void widen(config_char_t *const output, const char *const input, const size_t len)
+{
+	size_t i;
+	for(i = 0U; i < len; ++i)
+	{
+		output[i] = (config_char_t)(unsigned char) input[i];
+	}
+	output[len] = 0x00;
+}
+
+static config_t *parse_text(const char *const text, const size_t len)
+{
+	config_t *const config = (config_t*) calloc(1U, sizeof(config_t) + (len * sizeof(config_char_t)));
+	if(config)
+	{
+		widen(config->text, text, len);
+		config_parse(config);
+	}
+	return config;
+}
+
+static config_t *load_file(void)
+{
+	static char buffer[0x10000U];
+	config_t *config = NULL;
+	size_t len;
+
+	FILE *const file = fopen(FILE_NAME, "rb");
+	if(file)
+	{
+		len = fread(buffer, 1U, sizeof(buffer), file);
+		fclose(file);
+		config = parse_text(buffer, len);
+	}
+
+	return config;
+}
+
+static int lookup(const config_t *const config, const char *const name, char *const value, const size_t size)
+{
+	config_char_t key[64U];
+	const config_char_t *text;
+	size_t i;
+
+	widen(key, name, strlen(name));
+	if(!(text = config_find(config, key)))
+	{
+		return 0;
+	}
+
+	for(i = 0U; text[i] && (i < size - 1U); ++i)
+	{
+		value[i] = (char) text[i];
+	}
+	value[i] = '\0';
+	return 1;
+}
+
+static int has_value(const char *const text, const char *const name, const char *const expected)
+{
+	char value[64U];
+	config_t *const config = parse_text(text, strlen(text));
+	int result = 0;
+	if(config)
+	{
+		result = expected ? (lookup(config, name, value, sizeof(value)) && (!strcmp(value, expected))) : (!lookup(config, name, value, sizeof(value)));
+		free(config);
+	}
+	return result;
+}
+
+// ==========================================================================
+// Profile rules
+// ==========================================================================
+
+static void test_rules(void)
+{
+	CHECK(has_value("[ClearClipboard]\nTimeout=5000\n", "Timeout", "5000"));
+	CHECK(has_value("[ClearClipboard]\r\ntimeout=5000\r\n", "TIMEOUT", "5000"));        /*case-insensitive names*/
+	CHECK(has_value("[ clearclipboard ]\nTimeout=5000", "Timeout", "5000"));            /*section name trimmed, no final newline*/
+	CHECK(has_value("[ClearClipboard]\n  Timeout \t=  5000  \n", "Timeout", "5000"));   /*blanks trimmed*/
+	CHECK(has_value("[ClearClipboard]\nTimeout=\"5000\"\n", "Timeout", "5000"));        /*quotes removed*/
+	CHECK(has_value("[ClearClipboard]\nTimeout='\"5000\"'\n", "Timeout", "\"5000\""));  /*one pair only*/
+	CHECK(has_value("[ClearClipboard]\nTimeout=1\nTimeout=2\n", "Timeout", "1"));       /*first occurrence wins*/
+	CHECK(has_value("[ClearClipboard]\nTimeout=a=b\n", "Timeout", "a=b"));
+	CHECK(has_value("[ClearClipboard]\nTimeout=\n", "Timeout", ""));
+	CHECK(has_value("[ClearClipboard]\n;Timeout=5000\n", "Timeout", NULL));             /*comment*/
+	CHECK(has_value("Timeout=5000\n[ClearClipboard]\n", "Timeout", NULL));              /*outside of the section*/
+	CHECK(has_value("[ClearClipboard]\n[Other]\nTimeout=5000\n", "Timeout", NULL));
+	CHECK(has_value("[Other]\nTimeout=1\n[ClearClipboard]\nTimeout=2\n", "Timeout", "2"));
+	CHECK(has_value("[ClearClipboard]\n=5000\nTimeout 5000\n", "Timeout", NULL));
+	CHECK(has_value(SAMPLE, "com.muldersoft.clear_clipboard", "1"));
+	CHECK(has_value(SAMPLE, "TimeoutOther", NULL));
+}
+
+// ==========================================================================
+// Startup cost
+// ==========================================================================
+
+static void bench_startup(void)
+{
+	const size_t count = sizeof(NAMES) / sizeof(NAMES[0U]);
+	unsigned long rounds[2U] = { 0UL, 0UL }, found[2U] = { 0UL, 0UL };
+	clock_t begin, end, elapsed[2U];
+	char value[64U];
+	config_t *config;
+	size_t i;
+	int mode;
+
+	FILE *const file = fopen(FILE_NAME, "wb");
+	if(!file)
+	{
+		fprintf(stderr, "Failed to create \"%s\"!\n", FILE_NAME);
+		++g_failed;
+		return;
+	}
+	fwrite(SAMPLE, 1U, strlen(SAMPLE), file);
+	fclose(file);
+
+	for(mode = 0; mode < 2; ++mode)
+	{
+		begin = end = clock();
+		while((end - begin) < (clock_t)(BENCH_SECONDS * CLOCKS_PER_SEC))
+		{
+			found[mode] = 0UL;
+			config = (mode == 0) ? load_file() : NULL;
+			for(i = 0U; i < count; ++i)
+			{
+				if(mode != 0)
+				{
+					config = load_file(); /*re-read for every setting*/
+				}
+				if(config)
+				{
+					found[mode] += (unsigned long) lookup(config, NAMES[i], value, sizeof(value));
+				}
+				if(mode != 0)
+				{
+					free(config);
+					config = NULL;
+				}
+			}
+			free(config);
+			++rounds[mode];
+			end = clock();
+		}
+		elapsed[mode] = end - begin;
+	}
+
+	remove(FILE_NAME);
+
+	CHECK(found[0U] == count - 1U); /*TimeoutOther is not set*/
+	CHECK(found[1U] == found[0U]);
+	printf("settings:        %lu (file of %lu bytes)\n", (unsigned long) count, (unsigned long) strlen(SAMPLE));
+	printf("load.once:       %8.2f us\n", ((double)elapsed[0U]) * 1e6 / CLOCKS_PER_SEC / rounds[0U]);
+	printf("load.per_key:    %8.2f us\n", ((double)elapsed[1U]) * 1e6 / CLOCKS_PER_SEC / rounds[1U]);
+}
+
+// ==========================================================================
+// MAIN
+// ==========================================================================
+
+int main(void)
+{
+	test_rules();
+	bench_startup();
+
+	if(g_failed)
+	{
+		fprintf(stderr, "%lu check(s) failed!\n", g_failed);
+		return 1;
+	}
+
+	printf("All checks passed.\n");
+	return 0;
+}
@@ -0,0 +1,139 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* ClearClipboard - Control Pipe Benchmark                                                        */
+/* Copyright(c) 2019 LoRd_MuldeR <mulder2@gmx.de>                                                 */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * Measures the round trip of the control pipe of a running ClearClipboard instance (see README).
+ * This is a Windows console program without any further dependencies; build it with "cl ControlBench.c".
+ *
+ * Every round trip opens a new connection, because the server handles exactly one request per connection,
+ * sends a "get state" request and waits for the response, i.e. it covers the pipe connect, the transaction
+ * and the hand-off to the window procedure. The program reports the average, minimum and maximum time.
+ */
+
+#define WIN32_LEAN_AND_MEAN 1
+#include <Windows.h>
+#include <stdio.h>
+
+// Const
+#define CONTROL_MAGIC 0x4C544343UL
+#define CONTROL_VERSION 1U
+#define CONTROL_GET_STATE 5U
+#define CONTROL_OK 0U
+#define ROUND_TRIPS 1000UL
+
+// Wire layout
+typedef struct
+{
+	WORD opcode, status;
+	DWORD value;
+}
+command_t;
+typedef struct
+{
+	DWORD magic;
+	WORD version, count;
+	command_t command;
+}
+message_t;
+
+// ==========================================================================
+// Helper functions
+// ==========================================================================
+
+static BOOL get_pipe_name(WCHAR *const buffer, const size_t size)
+{
+	DWORD session = 0U;
+	if(!ProcessIdToSessionId(GetCurrentProcessId(), &session))
+	{
+		return FALSE;
+	}
+	return (_snwprintf(buffer, size, L"\\\\.\\pipe\\ClearClipboard.%u.control", session) > 0);
+}
+
+static BOOL round_trip(const WCHAR *const pipe_name)
+{
+	message_t request, response;
+	DWORD mode = PIPE_READMODE_MESSAGE, bytes = 0U;
+	BOOL success = FALSE;
+	HANDLE pipe;
+
+	while((pipe = CreateFileW(pipe_name, GENERIC_READ | GENERIC_WRITE, 0U, NULL, OPEN_EXISTING, 0U, NULL)) == INVALID_HANDLE_VALUE)
+	{
+		if((GetLastError() != ERROR_PIPE_BUSY) || (!WaitNamedPipeW(pipe_name, 1000U)))
+		{
+			return FALSE;
+		}
+	}
+
+	ZeroMemory(&request, sizeof(request));
+	request.magic = CONTROL_MAGIC;
+	request.version = CONTROL_VERSION;
+	request.count = 1U;
+	request.command.opcode = CONTROL_GET_STATE;
+
+	if(SetNamedPipeHandleState(pipe, &mode, NULL, NULL))
+	{
+		if(TransactNamedPipe(pipe, &request, sizeof(request), &response, sizeof(response), &bytes, NULL))
+		{
+			success = (bytes == sizeof(response)) && (response.magic == CONTROL_MAGIC) && (response.command.status == CONTROL_OK);
+		}
+	}
+
+	CloseHandle(pipe);
+	return success;
+}
+
+// ==========================================================================
+// MAIN
+// ==========================================================================
+
+int main(void)
+{
+	WCHAR pipe_name[64U];
+	LARGE_INTEGER frequency, begin, end;
+	LONGLONG total = 0, minimum = MAXLONGLONG, maximum = 0;
+	unsigned long i;
+
+	if(!(get_pipe_name(pipe_name, 64U) && QueryPerformanceFrequency(&frequency)))
+	{
+		fprintf(stderr, "Initialization failed!\n");
+		return 1;
+	}
+
+	for(i = 0UL; i < ROUND_TRIPS; ++i)
+	{
+		QueryPerformanceCounter(&begin);
+		if(!round_trip(pipe_name))
+		{
+			fprintf(stderr, "Request failed, is ClearClipboard running? (error %lu)\n", GetLastError());
+			return 1;
+		}
+		QueryPerformanceCounter(&end);
+		total += end.QuadPart - begin.QuadPart;
+		if(end.QuadPart - begin.QuadPart < minimum) minimum = end.QuadPart - begin.QuadPart;
+		if(end.QuadPart - begin.QuadPart > maximum) maximum = end.QuadPart - begin.QuadPart;
+	}
+
+	printf("round trips:     %lu\n", ROUND_TRIPS);
+	printf("time.avg:        %.1f us\n", ((double)total) * 1e6 / frequency.QuadPart / ROUND_TRIPS);
+	printf("time.min:        %.1f us\n", ((double)minimum) * 1e6 / frequency.QuadPart);
+	printf("time.max:        %.1f us\n", ((double)maximum) * 1e6 / frequency.QuadPart);
+	return 0;
+}
@@ -0,0 +1,286 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* ClearClipboard - Hash Test                                                                      */
+/* Copyright(c) 2019 LoRd_MuldeR <mulder2@gmx.de>                                                 */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * Checks the xxHash32 implementation of the clipboard fingerprint (see "src/Hash.h") and measures its speed.
+ * This is a portable C program without any dependencies; build it with any C compiler, e.g. "cl HashTest.c".
+ *
+ * The program checks the published xxHash32 test vectors and compares hash_xxh32() against a straightforward
+ * byte-wise reference implementation, for all lengths and alignments up to a few hundred bytes. The same is
+ * done for an SSE2 variant, which processes the four lanes in one register and emulates the 32-bit multiply
+ * with _mm_mul_epu32(). Then it reports the throughput and the time per call of both, for payloads from 1 KB
+ * up to 500 MB (ClearClipboard only hashes FINGERPRINT_LIMIT bytes). The exit code is non-zero, if any check has failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define HAVE_SSE2 1
+#endif
+
+#include "../src/Hash.h"
+
+// Const
+#define FINGERPRINT_LIMIT 0x10000U
+#define BENCH_SECONDS 0.5
+#define MAX_PAYLOAD (500UL << 20)
+
+// Check macro
+#define CHECK(X) do \
+{ \
+	if(!(X)) \
+	{ \
+		fprintf(stderr, "Check failed: %s (line %d)\n", #X, __LINE__); \
+		++g_failed; \
+	} \
+} \
+while(0)
+
+static unsigned long g_failed = 0UL;
+static unsigned long g_random = 42UL;
+
+// ==========================================================================
+// Helper functions
+// ==========================================================================
+
+static unsigned int next_random(const unsigned int range)
+{
+	g_random = (g_random * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+	return (unsigned int)((g_random >> 8) % range);
+}
+
+static unsigned int read_le32(const unsigned char *const data)
+{
+	return ((unsigned int)data[0U]) | (((unsigned int)data[1U]) << 8) | (((unsigned int)data[2U]) << 16) | (((unsigned int)data[3U]) << 24);
+}
+
+static unsigned int rotl32(const unsigned int x, const unsigned int n)
+{
+	return ((x << n) | (x >> (32U - n))) & 0xFFFFFFFFU;
+}
+
+/*reference implementation, following the specification as literally as possible*/
+static unsigned int reference_xxh32(const unsigned char *const data, const size_t size)
+{
+	unsigned int acc, lane[4U], i;
+	size_t pos = 0U;
+
+	if(size >= 16U)
+	{
+		lane[0U] = HASH_PRIME32_1 + HASH_PRIME32_2;
+		lane[1U] = HASH_PRIME32_2;
+		lane[2U] = 0U;
+		lane[3U] = 0U - HASH_PRIME32_1;
+		for(; pos + 16U <= size; pos += 16U)
+		{
+			for(i = 0U; i < 4U; ++i)
+			{
+				lane[i] = rotl32(lane[i] + read_le32(data + pos + (4U * i)) * HASH_PRIME32_2, 13U) * HASH_PRIME32_1;
+			}
+		}
+		acc = rotl32(lane[0U], 1U) + rotl32(lane[1U], 7U) + rotl32(lane[2U], 12U) + rotl32(lane[3U], 18U);
+	}
+	else
+	{
+		acc = HASH_PRIME32_5;
+	}
+
+	acc += (unsigned int)size;
+	for(; pos + 4U <= size; pos += 4U)
+	{
+		acc = rotl32(acc + read_le32(data + pos) * HASH_PRIME32_3, 17U) * HASH_PRIME32_4;
+	}
+	for(; pos < size; ++pos)
+	{
+		acc = rotl32(acc + data[pos] * HASH_PRIME32_5, 11U) * HASH_PRIME32_1;
+	}
+
+	acc ^= acc >> 15;
+	acc *= HASH_PRIME32_2;
+	acc ^= acc >> 13;
+	acc *= HASH_PRIME32_3;
+	acc ^= acc >> 16;
+	return acc;
+}
+
+#ifdef HAVE_SSE2
+static __m128i mullo_epi32(const __m128i a, const __m128i b)
+{
+	const __m128i even = _mm_mul_epu32(a, b);
+	const __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a, 32), _mm_srli_epi64(b, 32));
+	return _mm_unpacklo_epi32(_mm_shuffle_epi32(even, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+/*SSE2 variant: the stripe loop runs in one register, the tail is shared with hash_xxh32()*/
+static unsigned int sse2_xxh32(const unsigned char *const data, const size_t size)
+{
+	const __m128i prime_1 = _mm_set1_epi32((int)HASH_PRIME32_1), prime_2 = _mm_set1_epi32((int)HASH_PRIME32_2);
+	unsigned int lane[4U], acc;
+	size_t pos = 0U;
+	__m128i state;
+
+	if(size < 16U)
+	{
+		return hash_xxh32(data, size);
+	}
+
+	lane[0U] = HASH_PRIME32_1 + HASH_PRIME32_2;
+	lane[1U] = HASH_PRIME32_2;
+	lane[2U] = 0U;
+	lane[3U] = 0U - HASH_PRIME32_1;
+	state = _mm_loadu_si128((const __m128i*)lane);
+	for(; pos + 16U <= size; pos += 16U)
+	{
+		state = _mm_add_epi32(state, mullo_epi32(_mm_loadu_si128((const __m128i*)(data + pos)), prime_2));
+		state = mullo_epi32(_mm_or_si128(_mm_slli_epi32(state, 13), _mm_srli_epi32(state, 19)), prime_1);
+	}
+	_mm_storeu_si128((__m128i*)lane, state);
+
+	acc = rotl32(lane[0U], 1U) + rotl32(lane[1U], 7U) + rotl32(lane[2U], 12U) + rotl32(lane[3U], 18U);
+	acc += (unsigned int)size;
+	for(; pos + 4U <= size; pos += 4U)
+	{
+		acc = rotl32(acc + read_le32(data + pos) * HASH_PRIME32_3, 17U) * HASH_PRIME32_4;
+	}
+	for(; pos < size; ++pos)
+	{
+		acc = rotl32(acc + data[pos] * HASH_PRIME32_5, 11U) * HASH_PRIME32_1;
+	}
+
+	acc ^= acc >> 15;
+	acc *= HASH_PRIME32_2;
+	acc ^= acc >> 13;
+	acc *= HASH_PRIME32_3;
+	acc ^= acc >> 16;
+	return acc;
+}
+#endif //HAVE_SSE2
+
+typedef unsigned int (*hash_fn_t)(const unsigned char *const data, const size_t size);
+
+static unsigned int hash_string(const hash_fn_t hash, const char *const text)
+{
+	return hash((const unsigned char*)text, strlen(text));
+}
+
+// ==========================================================================
+// Test vectors
+// ==========================================================================
+
+static void test_vectors(const hash_fn_t hash)
+{
+	CHECK(hash_string(hash, "") == 0x02CC5D05U);
+	CHECK(hash_string(hash, "a") == 0x550D7456U);
+	CHECK(hash_string(hash, "abc") == 0x32D153FFU);
+	CHECK(hash_string(hash, "Nobody inspects the spammish repetition") == 0xE2293B2FU);
+}
+
+static void test_reference(const hash_fn_t hash, const unsigned char *const buffer)
+{
+	size_t offset, size;
+	for(offset = 0U; offset < 16U; ++offset)
+	{
+		for(size = 0U; size <= 256U; ++size)
+		{
+			CHECK(hash(buffer + offset, size) == reference_xxh32(buffer + offset, size));
+		}
+	}
+	CHECK(hash(buffer + 1U, FINGERPRINT_LIMIT) == reference_xxh32(buffer + 1U, FINGERPRINT_LIMIT));
+}
+
+// ==========================================================================
+// Throughput
+// ==========================================================================
+
+static void bench_hash(const hash_fn_t hash, const unsigned char *const buffer, const char *const name)
+{
+	static const unsigned long SIZES[] = { 1UL << 10, 0x10000UL, 1UL << 20, 16UL << 20, MAX_PAYLOAD };
+	volatile unsigned int sink = 0U;
+	size_t i;
+
+	for(i = 0U; i < sizeof(SIZES) / sizeof(SIZES[0U]); ++i)
+	{
+		unsigned long rounds = 0UL;
+		clock_t begin, end;
+		double seconds;
+		begin = end = clock();
+		while((!rounds) || ((end - begin) < (clock_t)(BENCH_SECONDS * CLOCKS_PER_SEC)))
+		{
+			sink += hash(buffer, SIZES[i]);
+			++rounds;
+			if(!(rounds & 0xFFUL) || (SIZES[i] >= (1UL << 20)))
+			{
+				end = clock();
+			}
+		}
+		seconds = ((double)(end - begin)) / CLOCKS_PER_SEC;
+		printf("%s %9lu KB: %6.2f GB/s, %12.3f us/call\n", name, SIZES[i] >> 10, (((double)rounds) * SIZES[i]) / seconds / 1073741824.0, seconds * 1e6 / rounds);
+	}
+
+	(void)sink;
+}
+
+// ==========================================================================
+// MAIN
+// ==========================================================================
+
+int main(void)
+{
+	unsigned char *const buffer = (unsigned char*) malloc(MAX_PAYLOAD);
+	unsigned long i;
+
+	if(!buffer)
+	{
+		fprintf(stderr, "Out of memory!\n");
+		return 1;
+	}
+
+	for(i = 0UL; i < MAX_PAYLOAD; ++i)
+	{
+		buffer[i] = (unsigned char) next_random(256U);
+	}
+
+	test_vectors(hash_xxh32);
+	test_reference(hash_xxh32, buffer);
+#ifdef HAVE_SSE2
+	test_vectors(sse2_xxh32);
+	test_reference(sse2_xxh32, buffer);
+#endif
+
+	bench_hash(hash_xxh32, buffer, "xxh32.scalar:");
+#ifdef HAVE_SSE2
+	bench_hash(sse2_xxh32, buffer, "xxh32.sse2:  ");
+#endif
+
+	free(buffer);
+
+	if(g_failed)
+	{
+		fprintf(stderr, "%lu check(s) failed!\n", g_failed);
+		return 1;
+	}
+
+	printf("All checks passed.\n");
+	return 0;
+}
@@ -0,0 +1,289 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* ClearClipboard - Log Test                                                                       */
+/* Copyright(c) 2019 LoRd_MuldeR <mulder2@gmx.de>                                                 */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * Checks the log ring and the record formatting (see "src/Log.h") and measures the cost of a log call.
+ * This is a portable C program without any dependencies; build it with any C compiler, e.g. "cl LogTest.c".
+ *
+ * The program checks that the arguments are copied by type (pointers and int-sized values mixed), that
+ * long lines are cut off with a marker, and that a full ring drops messages. Then it reports the cost per
+ * call of a TRACE2()-style message, with tracing disabled (the level check only) and enabled (record
+ * stored in the ring), as well as the cost of formatting a record on the logging thread. The benchmark is
+ * single-threaded, so it does not include contention. The exit code is non-zero, if any check has failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#define LOG_CAS(X,Y,Z) _InterlockedCompareExchange((X),(Y),(Z))
+#define LOG_XCHG(X,Y) _InterlockedExchange((X),(Y))
+#define LOG_INC(X) _InterlockedIncrement((X))
+#else
+#define LOG_CAS(X,Y,Z) __sync_val_compare_and_swap((X),(Z),(Y))
+#define LOG_XCHG(X,Y) __atomic_exchange_n((X),(Y),__ATOMIC_SEQ_CST)
+#define LOG_INC(X) __sync_add_and_fetch((X),1L)
+#endif
+#if defined(_MSC_VER) && (_MSC_VER < 1900)
+#define LOG_SNPRINTF _snprintf
+#else
+#define LOG_SNPRINTF snprintf
+#endif
+
+#include "../src/Log.h"
+
+// Const
+#define LOG_LINE_SIZE 256U
+#define BENCH_ROUNDS 10000000UL
+
+// Check macro
+#define CHECK(X) do \
+{ \
+	if(!(X)) \
+	{ \
+		fprintf(stderr, "Check failed: %s (line %d)\n", #X, __LINE__); \
+		++g_failed; \
+	} \
+} \
+while(0)
+
+// Log call, like the TRACE2() macro
+#define TRACE2(X,...) do \
+{ \
+	if(g_debug >= 2U) \
+		log_write("ClearClipboard -- " X "\n", __VA_ARGS__); \
+} \
+while(0)
+
+static unsigned long g_failed = 0UL;
+static volatile unsigned int g_debug = 0U;
+static unsigned int g_clock = 0U;
+static log_ring_t g_ring;
+
+// ==========================================================================
+// Helper functions
+// ==========================================================================
+
+static int store(log_record_t *const record, const char *const format, ...)
+{
+	va_list args;
+	int result;
+	va_start(args, format);
+	result = log_record_store(record, format, args);
+	va_end(args);
+	return result;
+}
+
+static void log_write(const char *const format, ...)
+{
+	log_record_t *record;
+	va_list args;
+	long pos;
+
+	if(!(record = log_ring_acquire(&g_ring, &pos)))
+	{
+		return;
+	}
+
+	record->timestamp = ++g_clock;
+
+	va_start(args, format);
+	if(!log_record_store(record, format, args))
+	{
+		record->format = "ClearClipboard -- log message dropped: too many arguments!\n";
+	}
+	va_end(args);
+
+	log_ring_commit(&g_ring, record, pos);
+}
+
+static unsigned long drain(long *const tail)
+{
+	unsigned long count = 0UL;
+	log_record_t *record;
+	while((record = log_ring_peek(&g_ring, *tail)))
+	{
+		log_ring_release(record, (*tail)++);
+		++count;
+	}
+	return count;
+}
+
+// ==========================================================================
+// Format parsing
+// ==========================================================================
+
+static void test_parse(void)
+{
+	unsigned int pointers;
+
+	CHECK(log_parse_format("no arguments\n", &pointers) == 0U);
+	CHECK(log_parse_format("value=%u\n", &pointers) == 1U && pointers == 0U);
+	CHECK(log_parse_format("%s %u %S %p\n", &pointers) == 4U && pointers == 0xDU);
+	CHECK(log_parse_format("ratio=%u%%, hotkey=0x%03X\n", &pointers) == 2U && pointers == 0U);
+	CHECK(log_parse_format("%-8s|%08lX|%hu\n", &pointers) == 3U && pointers == 1U);
+	CHECK(log_parse_format("dangling %", &pointers) == 0U);
+	CHECK(log_parse_format("%s%s%s%s%s", &pointers) == 5U);
+}
+
+// ==========================================================================
+// Typed arguments and truncation
+// ==========================================================================
+
+static void test_format(void)
+{
+	static const char *const NAME = "Ditto";
+	log_record_t record;
+	char line[LOG_LINE_SIZE], small[32U];
+	int len;
+
+	CHECK(store(&record, "a=%u b=%s c=0x%04X d=%d\n", 7U, NAME, 0xABU, -5));
+	len = log_format_line(line, (int)sizeof(line), &record);
+	CHECK(!strcmp(line, "a=7 b=Ditto c=0x00AB d=-5\n"));
+	CHECK(len == (int)strlen(line));
+
+	CHECK(store(&record, "%s is running, ratio=%u%%\n", NAME, 42U));
+	log_format_line(line, (int)sizeof(line), &record);
+	CHECK(!strcmp(line, "Ditto is running, ratio=42%\n"));
+
+	CHECK(!store(&record, "%u %u %u %u %u\n", 1U, 2U, 3U, 4U, 5U)); /*too many arguments*/
+
+	CHECK(store(&record, "ClearClipboard -- %s is a rather long value: %u\n", "this string", 123456789U));
+	len = log_format_line(small, (int)sizeof(small), &record);
+	CHECK(len == (int)sizeof(small) - 1);
+	CHECK(!strcmp(small + sizeof(small) - 5U, "...\n"));
+
+	CHECK(store(&record, "exactly 31 characters, value=%u\n", 1U));
+	len = log_format_line(small, (int)sizeof(small), &record);
+	CHECK(!strcmp(small, "exactly 31 characters, value=1\n"));
+}
+
+// ==========================================================================
+// Ring
+// ==========================================================================
+
+static void test_ring(void)
+{
+	long pos, tail = 0L;
+	unsigned int i;
+
+	log_ring_init(&g_ring);
+	g_debug = 2U;
+
+	for(i = 0U; i < LOG_RING_SIZE + 3U; ++i)
+	{
+		TRACE2("message #%u", i);
+	}
+	CHECK(g_ring.dropped == 3L);
+	CHECK(drain(&tail) == LOG_RING_SIZE);
+
+	TRACE2("message #%u", 1U);
+	CHECK(drain(&tail) == 1UL);
+	CHECK(log_ring_acquire(&g_ring, &pos) != NULL);
+
+	g_ring.waiting = 1L;
+	CHECK(log_ring_commit(&g_ring, &g_ring.slots[pos & (LOG_RING_SIZE - 1U)], pos)); /*wakes the consumer*/
+	CHECK(!log_ring_commit(&g_ring, &g_ring.slots[pos & (LOG_RING_SIZE - 1U)], pos));
+	g_debug = 0U;
+}
+
+// ==========================================================================
+// CPU time
+// ==========================================================================
+
+static double elapsed_ns(const clock_t begin, const clock_t end, const unsigned long rounds)
+{
+	return ((double)(end - begin)) * 1e9 / CLOCKS_PER_SEC / rounds;
+}
+
+static void bench_calls(void)
+{
+	static const char *const NAME = "clipboard manager";
+	char line[LOG_LINE_SIZE];
+	volatile int sink = 0;
+	log_record_t *record;
+	long tail = 0L;
+	unsigned long i;
+	clock_t begin, end;
+
+	log_ring_init(&g_ring);
+
+	g_debug = 0U;
+	begin = clock();
+	for(i = 0UL; i < BENCH_ROUNDS; ++i)
+	{
+		TRACE2("timer armed: delay=%u, name=%s", (unsigned int)i, NAME);
+	}
+	end = clock();
+	printf("call.disabled:   %6.2f ns\n", elapsed_ns(begin, end, BENCH_ROUNDS));
+
+	g_debug = 2U;
+	begin = clock();
+	for(i = 0UL; i < BENCH_ROUNDS; ++i)
+	{
+		TRACE2("timer armed: delay=%u, name=%s", (unsigned int)i, NAME);
+		if(!((i + 1U) & (LOG_RING_SIZE - 1U)))
+		{
+			drain(&tail); /*release the slots, as the logging thread would*/
+		}
+	}
+	end = clock();
+	printf("call.enabled:    %6.2f ns (incl. slot release)\n", elapsed_ns(begin, end, BENCH_ROUNDS));
+	CHECK(g_ring.dropped == 0L);
+
+	drain(&tail);
+	TRACE2("timer armed: delay=%u, name=%s", 30000U, NAME);
+	record = log_ring_peek(&g_ring, tail);
+	CHECK(record != NULL);
+	begin = clock();
+	for(i = 0UL; record && (i < BENCH_ROUNDS / 10UL); ++i)
+	{
+		sink += log_format_line(line, (int)sizeof(line), record);
+	}
+	end = clock();
+	printf("format.line:     %6.2f ns\n", elapsed_ns(begin, end, BENCH_ROUNDS / 10UL));
+	CHECK(!strcmp(line, "ClearClipboard -- timer armed: delay=30000, name=clipboard manager\n"));
+	g_debug = 0U;
+	(void)sink;
+}
+
+// ==========================================================================
+// MAIN
+// ==========================================================================
+
+int main(void)
+{
+	test_parse();
+	test_format();
+	test_ring();
+	bench_calls();
+
+	if(g_failed)
+	{
+		fprintf(stderr, "%lu check(s) failed!\n", g_failed);
+		return 1;
+	}
+
+	printf("All checks passed.\n");
+	return 0;
+}
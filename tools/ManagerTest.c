@@ -0,0 +1,228 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* ClearClipboard - Manager Test                                                                  */
+/* Copyright(c) 2019 LoRd_MuldeR <mulder2@gmx.de>                                                 */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * Checks the detection of clipboard managers by process name (see "src/Managers.h") and measures its cost.
+ * This is a portable C program without any dependencies; build it with any C compiler, e.g. "cl ManagerTest.c".
+ *
+ * The program checks that every known executable name is found, regardless of its case, and that similar
+ * names are not. Then it scans synthetic process lists with the hash set and, for comparison, with a linear
+ * search over all known names, and reports the time per process and per snapshot. Taking the snapshot itself
+ * (CreateToolhelp32Snapshot) is Windows-only and not measured. The exit code is non-zero, if any check has failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "../src/Managers.h"
+
+// Const
+#define NAME_SIZE 64U
+#define BENCH_SECONDS 0.5
+
+// Check macro
+#define CHECK(X) do \
+{ \
+	if(!(X)) \
+	{ \
+		fprintf(stderr, "Check failed: %s (line %d)\n", #X, __LINE__); \
+		++g_failed; \
+	} \
+} \
+while(0)
+
+static unsigned long g_failed = 0UL;
+static unsigned long g_random = 42UL;
+static manager_table_t g_table;
+
+static const char *const SYSTEM_PROCESSES[] =
+{
+	"System", "Registry", "smss.exe", "csrss.exe", "wininit.exe", "services.exe", "lsass.exe", "svchost.exe", "fontdrvhost.exe",
+	"winlogon.exe", "dwm.exe", "explorer.exe", "RuntimeBroker.exe", "SearchHost.exe", "StartMenuExperienceHost.exe",
+	"ctfmon.exe", "sihost.exe", "taskhostw.exe", "conhost.exe", "dllhost.exe", "SecurityHealthService.exe", "MsMpEng.exe",
+	"spoolsv.exe", "audiodg.exe", "chrome.exe", "firefox.exe", "msedge.exe", "Teams.exe", "OUTLOOK.EXE", "WINWORD.EXE",
+	"Code.exe", "cmd.exe", "powershell.exe", "WindowsTerminal.exe", "OneDrive.exe", "ClearClipboard.exe"
+};
+
+// ==========================================================================
+// Helper functions
+// ==========================================================================
+
+static unsigned int next_random(const unsigned int range)
+{
+	g_random = (g_random * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+	return (unsigned int)((g_random >> 8) % range);
+}
+
+static void widen(unsigned short *const output, const char *const input)
+{
+	size_t i;
+	for(i = 0U; input[i] && (i < NAME_SIZE - 1U); ++i)
+	{
+		output[i] = (unsigned short)(unsigned char) input[i];
+	}
+	output[i] = 0U;
+}
+
+static int find(const char *const name)
+{
+	unsigned short buffer[NAME_SIZE];
+	widen(buffer, name);
+	return manager_find(&g_table, buffer);
+}
+
+static int find_linear(const unsigned short *const name)
+{
+	size_t i;
+	for(i = 0U; i < sizeof(CLIPBOARD_MANAGERS) / sizeof(CLIPBOARD_MANAGERS[0U]); ++i)
+	{
+		if(manager_compare(name, CLIPBOARD_MANAGERS[i].exe_name))
+		{
+			return (int)i;
+		}
+	}
+	return -1;
+}
+
+static void make_processes(unsigned short (*const names)[NAME_SIZE], const size_t count)
+{
+	static const char *const PARTS[] = { "Host", "Service", "Broker", "Update", "Helper", "Agent", "Clip", "Sync", "Tray", "App" };
+	char name[NAME_SIZE];
+	size_t i;
+
+	for(i = 0U; i < count; ++i)
+	{
+		if(i % 3U)
+		{
+			sprintf(name, "%s%s%u.exe", PARTS[next_random(10U)], PARTS[next_random(10U)], next_random(1000U));
+		}
+		else
+		{
+			strcpy(name, SYSTEM_PROCESSES[next_random(sizeof(SYSTEM_PROCESSES) / sizeof(SYSTEM_PROCESSES[0U]))]);
+		}
+		widen(names[i], name);
+	}
+}
+
+// ==========================================================================
+// Fixed cases
+// ==========================================================================
+
+static void test_names(void)
+{
+	char name[NAME_SIZE];
+	size_t i, j, used = 0U;
+
+	for(i = 0U; i < sizeof(CLIPBOARD_MANAGERS) / sizeof(CLIPBOARD_MANAGERS[0U]); ++i)
+	{
+		CHECK(find(CLIPBOARD_MANAGERS[i].exe_name) == (int)i);
+		for(j = 0U; CLIPBOARD_MANAGERS[i].exe_name[j]; ++j)
+		{
+			const char c = CLIPBOARD_MANAGERS[i].exe_name[j];
+			name[j] = ((c >= 'a') && (c <= 'z')) ? (char)(c - 0x20) : c;
+		}
+		name[j] = '\0';
+		CHECK(find(name) == (int)i); /*upper case*/
+		CHECK(find(CLIPBOARD_MANAGERS[i].display_name) < 0); /*no extension*/
+	}
+
+	for(i = 0U; i < MANAGER_TABLE_SIZE; ++i)
+	{
+		used += g_table.slots[i] ? 1U : 0U;
+	}
+	CHECK(used == sizeof(CLIPBOARD_MANAGERS) / sizeof(CLIPBOARD_MANAGERS[0U]));
+
+	CHECK(find("") < 0);
+	CHECK(find("Ditto.ex") < 0);
+	CHECK(find("Ditto.exe.exe") < 0);
+	CHECK(find("xDitto.exe") < 0);
+	CHECK(find("Clip.exe") < 0);
+	CHECK(find("svchost.exe") < 0);
+	CHECK(find("ClearClipboard.exe") < 0);
+}
+
+// ==========================================================================
+// Scan cost
+// ==========================================================================
+
+static void bench_scan(const size_t count)
+{
+	unsigned short (*const names)[NAME_SIZE] = (unsigned short(*)[NAME_SIZE]) malloc(count * sizeof(*names));
+	unsigned long rounds, matches[2U] = { 0UL, 0UL };
+	double seconds[2U];
+	clock_t begin, end;
+	size_t i;
+	int mode;
+
+	if(!names)
+	{
+		fprintf(stderr, "Out of memory!\n");
+		++g_failed;
+		return;
+	}
+
+	make_processes(names, count);
+
+	for(mode = 0; mode < 2; ++mode)
+	{
+		rounds = 0UL;
+		begin = end = clock();
+		while((end - begin) < (clock_t)(BENCH_SECONDS * CLOCKS_PER_SEC))
+		{
+			for(i = 0U; i < count; ++i)
+			{
+				matches[mode] += ((mode ? find_linear(names[i]) : manager_find(&g_table, names[i])) >= 0) ? 1UL : 0UL;
+			}
+			++rounds;
+			end = clock();
+		}
+		seconds[mode] = ((double)(end - begin)) / CLOCKS_PER_SEC / rounds;
+		matches[mode] /= rounds;
+	}
+
+	CHECK(matches[0U] == 0UL && matches[1U] == 0UL);
+	printf("processes: %5lu   hash: %6.2f ns/process, %8.2f us/snapshot   linear: %6.2f ns/process, %8.2f us/snapshot\n",
+		(unsigned long) count, seconds[0U] * 1e9 / count, seconds[0U] * 1e6, seconds[1U] * 1e9 / count, seconds[1U] * 1e6);
+	free(names);
+}
+
+// ==========================================================================
+// MAIN
+// ==========================================================================
+
+int main(void)
+{
+	manager_table_init(&g_table);
+
+	test_names();
+	bench_scan(300U);
+	bench_scan(10000U);
+
+	if(g_failed)
+	{
+		fprintf(stderr, "%lu check(s) failed!\n", g_failed);
+		return 1;
+	}
+
+	printf("All checks passed.\n");
+	return 0;
+}
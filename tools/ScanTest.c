@@ -0,0 +1,401 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* ClearClipboard - Scanner Test                                                                  */
+/* Copyright(c) 2019 LoRd_MuldeR <mulder2@gmx.de>                                                 */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * Checks the detection of sensitive text (see "src/Scan.h") and measures its throughput.
+ * This is a portable C program without any dependencies; build it with any C compiler, e.g. "cl ScanTest.c".
+ *
+ * The program generates card numbers, IBANs, API keys and random passwords, which must be detected, as well
+ * as invalid variants of them and common non-secret tokens, which must not. It reports the detection rate
+ * of random passwords, the false positives in a synthetic corpus of prose and source code, and the time it
+ * takes to scan one MB of text, which bounds the cost of scanning SCAN_LIMIT characters. Where available,
+ * the SSE2 tokenizer is checked against the scalar one. The exit code is non-zero, if any check has failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define HAVE_SSE2 1
+#endif
+
+#include "../src/Scan.h"
+
+// Const
+#define SCAN_LIMIT 0x400000U
+#define SAMPLE_COUNT 10000U
+#define CORPUS_SIZE 0x400000U
+#define CHUNK_SIZE 0x800U
+#define BENCH_SECONDS 1.0
+
+// Check macro
+#define CHECK(X) do \
+{ \
+	if(!(X)) \
+	{ \
+		fprintf(stderr, "Check failed: %s (line %d)\n", #X, __LINE__); \
+		++g_failed; \
+	} \
+} \
+while(0)
+
+static unsigned long g_failed = 0UL;
+static unsigned long g_random = 42UL;
+
+static const char *const WORDS[] =
+{
+	"the", "clipboard", "will", "be", "cleared", "after", "timeout", "of", "seconds", "and", "a", "new", "item",
+	"is", "copied", "to", "Windows", "application", "password", "for", "user", "account", "settings", "file",
+	"configuration", "in", "with", "Microsoft", "Office", "document", "text", "image", "format", "data", "January",
+	"meeting", "Monday", "project", "release", "version", "please", "send", "me", "report", "number", "invoice",
+	"ClearClipboard", "getElementById", "HKEY_CURRENT_USER", "std::vector<int>", "printf(\"%d\\n\",", "return",
+	"0x7FFFFFFF", "2019-12-31", "23:59:59", "+49", "(555)", "1234", "42", "3.14159", "https://example.com/index.html",
+	"C:\\Windows\\System32", "user@example.com", "SELECT", "FROM", "WHERE", "id", "=", "{", "}", ";"
+};
+
+// ==========================================================================
+// Helper functions
+// ==========================================================================
+
+static unsigned int next_random(const unsigned int range)
+{
+	g_random = (g_random * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+	return (unsigned int)((g_random >> 8) % range);
+}
+
+static unsigned int detect(const char *const text, const int use_sse2)
+{
+	static scan_char_t buffer[512U];
+	size_t len;
+
+	for(len = 0U; text[len] && (len < 511U); ++len)
+	{
+		buffer[len] = (scan_char_t)(unsigned char) text[len];
+	}
+	buffer[len] = 0U;
+
+	return scan_sensitive_text(buffer, len, use_sse2);
+}
+
+static unsigned int detect_all(const char *const text)
+{
+	const unsigned int result = detect(text, 0);
+#ifdef HAVE_SSE2
+	CHECK(detect(text, 1) == result); /*same result for both tokenizers*/
+#endif
+	return result;
+}
+
+static void random_string(char *const buffer, const unsigned int len, const char *const alphabet)
+{
+	const unsigned int size = (unsigned int) strlen(alphabet);
+	unsigned int i;
+	for(i = 0U; i < len; ++i)
+	{
+		buffer[i] = alphabet[next_random(size)];
+	}
+	buffer[len] = '\0';
+}
+
+static void make_card(char *const buffer, const unsigned int len)
+{
+	unsigned int i, sum = 0U;
+	buffer[0U] = (char)('2' + next_random(5U));
+	for(i = 1U; i < len - 1U; ++i)
+	{
+		buffer[i] = (char)('0' + next_random(10U));
+	}
+	for(i = 0U; i < len - 1U; ++i)
+	{
+		unsigned int value = buffer[len - i - 2U] - '0';
+		if(!(i & 1U))
+		{
+			value = (value > 4U) ? ((2U * value) - 9U) : (2U * value);
+		}
+		sum += value;
+	}
+	buffer[len - 1U] = (char)('0' + ((10U - (sum % 10U)) % 10U));
+	buffer[len] = '\0';
+}
+
+static void make_iban(char *const buffer, const char *const country, const unsigned int len)
+{
+	unsigned int i, remainder = 0U;
+	for(i = 4U; i < len; ++i)
+	{
+		buffer[i] = (char)('0' + next_random(10U));
+		remainder = ((remainder * 10U) + (buffer[i] - '0')) % 97U;
+	}
+	remainder = ((remainder * 100U) + (country[0U] - 'A' + 10U)) % 97U;
+	remainder = ((remainder * 100U) + (country[1U] - 'A' + 10U)) % 97U;
+	remainder = (remainder * 100U) % 97U;
+	buffer[0U] = country[0U];
+	buffer[1U] = country[1U];
+	buffer[2U] = (char)('0' + ((98U - remainder) / 10U));
+	buffer[3U] = (char)('0' + ((98U - remainder) % 10U));
+	buffer[len] = '\0';
+}
+
+static void group_digits(char *const output, const char *const input, const unsigned int size, const char separator)
+{
+	unsigned int i, j = 0U;
+	for(i = 0U; input[i]; ++i)
+	{
+		if(i && (!(i % size)))
+		{
+			output[j++] = separator;
+		}
+		output[j++] = input[i];
+	}
+	output[j] = '\0';
+}
+
+static void mutate_digit(char *const buffer, const unsigned int first, const unsigned int len)
+{
+	const unsigned int pos = first + next_random(len - first);
+	buffer[pos] = (char)('0' + ((buffer[pos] - '0' + 1U + next_random(9U)) % 10U));
+}
+
+// ==========================================================================
+// Card numbers and IBANs
+// ==========================================================================
+
+static void test_cards(void)
+{
+	char number[24U], text[64U];
+	unsigned int i, len;
+
+	CHECK(detect_all("4111111111111111") == SCAN_CARD);
+	CHECK(detect_all("card: 4111 1111 1111 1111, exp. 12/29") == SCAN_CARD);
+	CHECK(detect_all("5500-0000-0000-0004") == SCAN_CARD);
+	CHECK(detect_all("378282246310005") == SCAN_CARD);
+	CHECK(detect_all("4111111111111112") == SCAN_NONE); /*invalid check digit*/
+	CHECK(detect_all("1111111111111117") == SCAN_NONE); /*no issuer starts with 1*/
+	CHECK(detect_all("411111111111") == SCAN_NONE);     /*too short*/
+
+	for(i = 0U; i < SAMPLE_COUNT; ++i)
+	{
+		len = 13U + next_random(7U);
+		make_card(number, len);
+		CHECK(detect_all(number) == SCAN_CARD);
+		group_digits(text, number, 4U, (i & 1U) ? ' ' : '-');
+		CHECK(detect_all(text) == SCAN_CARD);
+		mutate_digit(number, 1U, len);
+		CHECK(detect_all(number) == SCAN_NONE); /*Luhn detects all single-digit errors*/
+	}
+}
+
+static void test_ibans(void)
+{
+	static const char *const COUNTRIES[] = { "DE", "GB", "FR", "NL", "CH", "AT", "ES", "IT" };
+	char iban[40U], text[64U];
+	unsigned int i, len;
+
+	CHECK(detect_all("DE89370400440532013000") == SCAN_IBAN);
+	CHECK(detect_all("IBAN: DE89 3704 0044 0532 0130 00") == SCAN_IBAN);
+	CHECK(detect_all("GB82WEST12345698765432") == SCAN_IBAN);
+	CHECK(detect_all("FR1420041010050500013M02606") == SCAN_IBAN);
+	CHECK(detect_all("DE89370400440532013001") == SCAN_NONE); /*invalid check digits*/
+
+	for(i = 0U; i < SAMPLE_COUNT; ++i)
+	{
+		len = 15U + next_random(15U);
+		make_iban(iban, COUNTRIES[next_random(sizeof(COUNTRIES) / sizeof(COUNTRIES[0U]))], len);
+		CHECK(detect_all(iban) == SCAN_IBAN);
+		group_digits(text, iban, 4U, ' ');
+		CHECK(detect_all(text) == SCAN_IBAN);
+		mutate_digit(iban, 4U, len);
+		CHECK(detect_all(iban) == SCAN_NONE); /*mod 97 detects all single-digit errors*/
+	}
+}
+
+// ==========================================================================
+// API keys and passwords
+// ==========================================================================
+
+static void test_keys(void)
+{
+	char key[160U];
+	size_t i, j;
+
+	for(i = 0U; i < sizeof(SCAN_KEY_PREFIXES) / sizeof(SCAN_KEY_PREFIXES[0U]); ++i)
+	{
+		const size_t prefix_len = strlen(SCAN_KEY_PREFIXES[i].prefix);
+		for(j = 0U; j < SAMPLE_COUNT / 100U; ++j)
+		{
+			strcpy(key, SCAN_KEY_PREFIXES[i].prefix);
+			random_string(key + prefix_len, SCAN_KEY_PREFIXES[i].min_length - (unsigned int)prefix_len + next_random(40U), "abcdefghijklmnopqrstuvwxyz");
+			CHECK(detect_all(key) == SCAN_KEY);
+			random_string(key + prefix_len, SCAN_KEY_PREFIXES[i].min_length - (unsigned int)prefix_len - 1U, "abcdefghijklmnopqrstuvwxyz");
+			CHECK(detect_all(key) == SCAN_NONE); /*too short for this prefix*/
+		}
+	}
+}
+
+static void test_entropy(void)
+{
+	static const char *const PRINTABLE = "!\"#$%&'()*+,-.0123456789:;<=>?@ABCDEFGHIJKLMNOPQRSTUVWXYZ[]^_`abcdefghijklmnopqrstuvwxyz{|}~";
+	static const char *const ALNUM = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+	static const char *const COMMON[] =
+	{
+		"getElementById", "ClearClipboard.exe", "HKEY_CURRENT_USER", "2019-12-31T23:59:59Z", "user@example.com",
+		"C:\\Windows\\System32", "https://github.com/lordmulder/ClearClipboard", "std::vector<int>", "3.14159265358979",
+		"Hello,World!", "SELECT*FROM", "0x7FFFFFFF,0x00000000", "WM_CLIPBOARDUPDATE", "(555)123-4567"
+	};
+	char token[64U];
+	unsigned int i, len, detected_printable = 0U, detected_alnum = 0U;
+	size_t j;
+
+	CHECK(detect_all("Tr0ub4dor&3xq") == SCAN_ENTROPY);
+	CHECK(detect_all("Password123!") == SCAN_ENTROPY);
+	CHECK(detect_all("v1.2.3-beta.4") == SCAN_ENTROPY); /*known false positive: version strings look random*/
+	CHECK(detect_all("Tr0ub4dor&3") == SCAN_NONE); /*shorter than SCAN_ENTROPY_MIN_LENGTH*/
+	CHECK(detect_all("correcthorsebatterystaple") == SCAN_NONE); /*single character class*/
+
+	for(j = 0U; j < sizeof(COMMON) / sizeof(COMMON[0U]); ++j)
+	{
+		const unsigned int result = detect_all(COMMON[j]);
+		if(result != SCAN_NONE)
+		{
+			fprintf(stderr, "False positive: \"%s\" (%s)\n", COMMON[j], SCAN_RESULT_NAMES[result]);
+		}
+		CHECK(result == SCAN_NONE);
+	}
+
+	for(i = 0U; i < SAMPLE_COUNT; ++i)
+	{
+		len = SCAN_ENTROPY_MIN_LENGTH + next_random(21U);
+		random_string(token, len, PRINTABLE);
+		detected_printable += (detect_all(token) != SCAN_NONE) ? 1U : 0U;
+		random_string(token, len, ALNUM);
+		detected_alnum += (detect_all(token) != SCAN_NONE) ? 1U : 0U;
+	}
+
+	printf("passwords.printable: %5.1f%% detected\n", 100.0 * detected_printable / SAMPLE_COUNT);
+	printf("passwords.alnum:     %5.1f%% detected\n", 100.0 * detected_alnum / SAMPLE_COUNT);
+	CHECK(detected_printable >= (SAMPLE_COUNT / 10U) * 9U);
+	CHECK(detected_alnum >= (SAMPLE_COUNT / 10U) * 8U);
+}
+
+// ==========================================================================
+// Corpus and throughput
+// ==========================================================================
+
+static void make_corpus(scan_char_t *const buffer, const size_t size)
+{
+	size_t pos = 0U;
+	while(pos < size - 1U)
+	{
+		const char *word = WORDS[next_random(sizeof(WORDS) / sizeof(WORDS[0U]))];
+		while(*word && (pos < size - 1U))
+		{
+			buffer[pos++] = (scan_char_t)(unsigned char)(*word++);
+		}
+		if(pos < size - 1U)
+		{
+			buffer[pos++] = next_random(12U) ? 0x20 : 0x0A;
+		}
+	}
+	buffer[size - 1U] = 0U;
+}
+
+static void test_corpus(scan_char_t *const corpus)
+{
+	unsigned long detected[5U] = { 0UL, 0UL, 0UL, 0UL, 0UL };
+	size_t pos;
+
+	/*scan the corpus in chunks of 4 KB, a typical size of a copied text*/
+	for(pos = 0U; pos + CHUNK_SIZE <= CORPUS_SIZE; pos += CHUNK_SIZE)
+	{
+		const unsigned int result = scan_sensitive_text(corpus + pos, CHUNK_SIZE, 0);
+		++detected[result];
+#ifdef HAVE_SSE2
+		CHECK(scan_sensitive_text(corpus + pos, CHUNK_SIZE, 1) == result);
+#endif
+	}
+
+	printf("corpus.chunks:       %lu\n", (unsigned long)(CORPUS_SIZE / CHUNK_SIZE));
+	printf("corpus.detected:     %lu cards, %lu ibans, %lu keys, %lu tokens\n", detected[SCAN_CARD], detected[SCAN_IBAN], detected[SCAN_KEY], detected[SCAN_ENTROPY]);
+	CHECK(detected[SCAN_IBAN] + detected[SCAN_KEY] + detected[SCAN_ENTROPY] == 0UL);
+	CHECK(detected[SCAN_CARD] <= (CORPUS_SIZE / CHUNK_SIZE) / 100U); /*runs of short numbers can pass the Luhn check*/
+}
+
+static void bench_scan(const scan_char_t *const corpus, const int use_sse2, const char *const name)
+{
+	volatile unsigned int sink = 0U;
+	unsigned long rounds = 0UL;
+	clock_t begin, end;
+	double msec_per_mb;
+	size_t pos;
+
+	begin = end = clock();
+	while((end - begin) < (clock_t)(BENCH_SECONDS * CLOCKS_PER_SEC))
+	{
+		for(pos = 0U; pos + CHUNK_SIZE <= CORPUS_SIZE; pos += CHUNK_SIZE)
+		{
+			sink += scan_sensitive_text(corpus + pos, CHUNK_SIZE, use_sse2);
+		}
+		++rounds;
+		end = clock();
+	}
+
+	msec_per_mb = (((double)(end - begin)) * 1000.0 / CLOCKS_PER_SEC) / ((((double)rounds) * CORPUS_SIZE * sizeof(scan_char_t)) / 1048576.0);
+	printf("%s %6.3f ms/MB, %6.2f ms per SCAN_LIMIT (%u KB)\n", name, msec_per_mb, msec_per_mb * (SCAN_LIMIT * sizeof(scan_char_t)) / 1048576.0, (unsigned int)((SCAN_LIMIT * sizeof(scan_char_t)) >> 10));
+	(void)sink;
+}
+
+// ==========================================================================
+// MAIN
+// ==========================================================================
+
+int main(void)
+{
+	scan_char_t *const corpus = (scan_char_t*) malloc(CORPUS_SIZE * sizeof(scan_char_t));
+	if(!corpus)
+	{
+		fprintf(stderr, "Out of memory!\n");
+		return 1;
+	}
+
+	test_cards();
+	test_ibans();
+	test_keys();
+	test_entropy();
+
+	make_corpus(corpus, CORPUS_SIZE);
+	test_corpus(corpus);
+	bench_scan(corpus, 0, "scan.scalar:        ");
+#ifdef HAVE_SSE2
+	bench_scan(corpus, 1, "scan.sse2:          ");
+#endif
+
+	free(corpus);
+
+	if(g_failed)
+	{
+		fprintf(stderr, "%lu check(s) failed!\n", g_failed);
+		return 1;
+	}
+
+	printf("All checks passed.\n");
+	return 0;
+}
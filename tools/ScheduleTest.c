@@ -0,0 +1,250 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* ClearClipboard - Scheduler Test                                                                */
+/* Copyright(c) 2019 LoRd_MuldeR <mulder2@gmx.de>                                                 */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * Checks the deadline arithmetic of the clear timer (see "src/Schedule.h") against a simulated clock.
+ * This is a portable C program without any dependencies; build it with any C compiler, e.g. "cl ScheduleTest.c".
+ *
+ * The program first checks schedule_expired() and schedule_delay() on fixed cases, then drives a simulated
+ * clipboard, where the timer fires up to TIMER_EARLY msec early or TIMER_LATE msec late, and asserts that
+ * every item is cleared no earlier than its deadline and no later than the worst-case bound. It reports
+ * the timer wakeups and the CPU time per event. Finally, it compares the wakeups per hour of the one-shot
+ * timer with those of the former polling timer (every Timeout/30 msec), for a range of copy rates. The
+ * exit code is non-zero, if any check has failed.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../src/Schedule.h"
+
+// Const
+#define TIMER_EARLY 5U
+#define TIMER_LATE 16U
+#define ITEM_COUNT 100000UL
+#define BENCH_ROUNDS 10000000UL
+#define HOUR 3600000U
+#define POLL_DIVISOR 30U
+
+// Check macro
+#define CHECK(X) do \
+{ \
+	if(!(X)) \
+	{ \
+		fprintf(stderr, "Check failed: %s (line %d)\n", #X, __LINE__); \
+		++g_failed; \
+	} \
+} \
+while(0)
+
+static unsigned long g_failed = 0UL;
+static unsigned long g_random = 42UL;
+
+// ==========================================================================
+// Helper functions
+// ==========================================================================
+
+static unsigned int next_random(const unsigned int range)
+{
+	g_random = (g_random * 1103515245UL + 12345UL) & 0x7FFFFFFFUL;
+	return (unsigned int)((g_random >> 8) % range);
+}
+
+// ==========================================================================
+// Fixed cases
+// ==========================================================================
+
+static void test_expired(void)
+{
+	CHECK(!schedule_expired(100000U, 0U, 0U));          /*zero timeout never expires*/
+	CHECK(!schedule_expired(1000U, 1000U, 5000U));
+	CHECK(!schedule_expired(5999U, 1000U, 5000U));
+	CHECK(schedule_expired(6000U, 1000U, 5000U));        /*exactly at the deadline*/
+	CHECK(schedule_expired(100000U, 1000U, 5000U));
+	CHECK(!schedule_expired(1000U, 2000U, 10U));         /*clock behind the copy time*/
+	CHECK(schedule_expired(0x100001388ULL, 0xFFFFFFFFULL, 5000U)); /*no 32-bit wrap-around*/
+}
+
+static void test_delay(void)
+{
+	CHECK(schedule_delay(1000U, 1000U, 0U) == 0U);
+	CHECK(schedule_delay(1000U, 1000U, 5000U) == 5000U);
+	CHECK(schedule_delay(3000U, 1000U, 5000U) == 3000U);
+	CHECK(schedule_delay(5995U, 1000U, 5000U) == SCHEDULE_MIN_DELAY);
+	CHECK(schedule_delay(6000U, 1000U, 30000U) == 25000U);
+	CHECK(schedule_delay(31000U, 1000U, 30000U) == 30000U / SCHEDULE_OVERDUE_DIVISOR); /*overdue*/
+	CHECK(schedule_delay(7000U, 1000U, 100U) == SCHEDULE_MIN_DELAY);
+	CHECK(schedule_delay(1000U, 2000U, 5000U) == 5000U); /*never longer than the timeout*/
+	CHECK(schedule_delay(5U, 0U, 1U) == SCHEDULE_MIN_DELAY);
+}
+
+// ==========================================================================
+// Simulated clipboard
+// ==========================================================================
+
+static void test_replay(void)
+{
+	static const unsigned int TIMEOUTS[] = { 1U, 50U, 1000U, 5000U, 30000U, 600000U };
+	schedule_tick_t now = 0U, lateness_max = 0U;
+	unsigned long item, cleared = 0UL, replaced = 0UL, wakeups = 0UL;
+
+	for(item = 0UL; item < ITEM_COUNT; ++item)
+	{
+		const unsigned int timeout = TIMEOUTS[next_random(sizeof(TIMEOUTS) / sizeof(TIMEOUTS[0U]))];
+		const schedule_tick_t start = now, deadline = start + timeout;
+		const schedule_tick_t next_item = start + next_random(2U * timeout + 1U); /*half of the items are replaced early*/
+		schedule_tick_t timer = now + schedule_delay(now, start, timeout);
+
+		for(;;)
+		{
+			const unsigned int jitter = next_random(TIMER_EARLY + TIMER_LATE + 1U);
+			const schedule_tick_t fired = (timer + jitter > now + TIMER_EARLY) ? (timer + jitter - TIMER_EARLY) : now;
+			if(fired >= next_item)
+			{
+				now = next_item;
+				++replaced;
+				break;
+			}
+			now = fired;
+			++wakeups;
+			if(schedule_expired(now, start, timeout))
+			{
+				CHECK(now >= deadline);
+				CHECK(now - deadline <= SCHEDULE_MIN_DELAY + TIMER_LATE);
+				if(now - deadline > lateness_max) lateness_max = now - deadline;
+				++cleared;
+				now += next_random(timeout + 1U); /*idle until the next copy*/
+				break;
+			}
+			CHECK(now < deadline);
+			timer = now + schedule_delay(now, start, timeout);
+			CHECK(timer > now);
+		}
+	}
+
+	CHECK(cleared + replaced == ITEM_COUNT);
+	printf("items:           %lu\n", ITEM_COUNT);
+	printf("ended.cleared:   %lu\n", cleared);
+	printf("ended.replaced:  %lu\n", replaced);
+	printf("wakeups:         %lu\n", wakeups);
+	printf("wakeups/item:    %.3f\n", ((double)wakeups) / ITEM_COUNT);
+	printf("lateness.max:    %lu ms\n", (unsigned long) lateness_max);
+}
+
+// ==========================================================================
+// Wakeups per hour
+// ==========================================================================
+
+static unsigned long count_wakeups(const unsigned int copies, const unsigned int timeout)
+{
+	const schedule_tick_t interval = copies ? (HOUR / copies) : HOUR;
+	schedule_tick_t now = 0U, timer = 0U, start = 0U, next_copy = copies ? 0U : HOUR;
+	unsigned long wakeups = 0UL;
+	int armed = 0;
+
+	for(;;)
+	{
+		if(armed && ((next_copy >= HOUR) || (timer < next_copy)))
+		{
+			now = timer;
+			++wakeups;
+			if(schedule_expired(now, start, timeout))
+			{
+				armed = 0; /*cleared, the clipboard stays empty until the next copy*/
+				continue;
+			}
+			timer = now + schedule_delay(now, start, timeout);
+			continue;
+		}
+		if((now = next_copy) >= HOUR) break;
+		start = now; /*a new copy moves the deadline*/
+		timer = now + schedule_delay(now, start, timeout);
+		armed = 1;
+		next_copy += interval;
+	}
+
+	return wakeups;
+}
+
+static void test_idle(void)
+{
+	static const unsigned int RATES[] = { 0U, 1U, 10U, 60U, 600U };
+	static const unsigned int TIMEOUTS[] = { 5000U, 30000U };
+	size_t i, j;
+
+	for(i = 0U; i < sizeof(TIMEOUTS) / sizeof(TIMEOUTS[0U]); ++i)
+	{
+		const unsigned long polling = HOUR / (TIMEOUTS[i] / POLL_DIVISOR);
+		for(j = 0U; j < sizeof(RATES) / sizeof(RATES[0U]); ++j)
+		{
+			const unsigned long wakeups = count_wakeups(RATES[j], TIMEOUTS[i]);
+			CHECK(wakeups <= polling);
+			if(RATES[j] * TIMEOUTS[i] <= HOUR) CHECK(wakeups == RATES[j]); /*one wakeup per item, if it is not replaced*/
+			printf("wakeups/hour:    %lu (polling: %lu) at %u copies/hour, timeout %u ms\n", wakeups, polling, RATES[j], TIMEOUTS[i]);
+		}
+	}
+}
+
+// ==========================================================================
+// CPU time
+// ==========================================================================
+
+static void bench_events(void)
+{
+	volatile unsigned int sink = 0U;
+	schedule_tick_t now = 0U;
+	unsigned long i;
+	clock_t begin, end;
+
+	begin = clock();
+	for(i = 0UL; i < BENCH_ROUNDS; ++i)
+	{
+		const schedule_tick_t start = now - (i & 0xFFFFU);
+		sink += (unsigned int) schedule_expired(now, start, 30000U) + schedule_delay(now, start, 30000U);
+		now += 7U;
+	}
+	end = clock();
+
+	printf("cpu/event:       %.2f ns\n", ((double)(end - begin)) * 1e9 / CLOCKS_PER_SEC / BENCH_ROUNDS);
+	(void)sink;
+}
+
+// ==========================================================================
+// MAIN
+// ==========================================================================
+
+int main(void)
+{
+	test_expired();
+	test_delay();
+	test_replay();
+	test_idle();
+	bench_events();
+
+	if(g_failed)
+	{
+		fprintf(stderr, "%lu check(s) failed!\n", g_failed);
+		return 1;
+	}
+
+	printf("All checks passed.\n");
+	return 0;
+}
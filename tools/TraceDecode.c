@@ -0,0 +1,502 @@
+/* ---------------------------------------------------------------------------------------------- */
+/* ClearClipboard - Trace Decoder                                                                 */
+/* Copyright(c) 2019 LoRd_MuldeR <mulder2@gmx.de>                                                 */
+/*                                                                                                */
+/* Permission is hereby granted, free of charge, to any person obtaining a copy of this software  */
+/* and associated documentation files (the "Software"), to deal in the Software without           */
+/* restriction, including without limitation the rights to use, copy, modify, merge, publish,     */
+/* distribute, sublicense, and/or sell copies of the Software, and to permit persons to whom the  */
+/* Software is furnished to do so, subject to the following conditions:                           */
+/*                                                                                                */
+/* The above copyright notice and this permission notice shall be included in all copies or       */
+/* substantial portions of the Software.                                                          */
+/*                                                                                                */
+/* THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR IMPLIED, INCLUDING  */
+/* BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND     */
+/* NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM,   */
+/* DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, */
+/* OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.        */
+/* ---------------------------------------------------------------------------------------------- */
+
+/*
+ * Decodes the binary trace files written by "ClearClipboard.exe --trace-file <path>".
+ * This is a portable C program without any dependencies; build it with any C compiler, e.g. "cl TraceDecode.c".
+ *
+ * In "--replay" mode, the recorded clipboard items are run against the given timeout settings, using the
+ * same deadline arithmetic as ClearClipboard itself (see "src/Schedule.h"), but with a simulated clock.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../src/Schedule.h"
+
+// Const
+#define HEADER_SIZE 24U
+#define RECORD_SIZE 16U
+#define FORMAT_VERSION 1U
+#define EVENT_COUNT 12U
+
+// Events
+#define EVENT_STOP 2U
+#define EVENT_TIMER 5U
+#define EVENT_CLEAR 7U
+#define EVENT_HOTKEY 8U
+#define EVENT_COMMAND 9U
+#define EVENT_ITEM 10U
+
+// Format classes
+#define CLASS_TEXT 1U
+#define CLASS_RICH 2U
+#define CLASS_COUNT 6U
+#define CLASS_TEXTUAL ((1U << CLASS_TEXT) | (1U << CLASS_RICH))
+#define TIMEOUT_DEFAULT (~0U)
+
+// Output modes
+#define MODE_CSV 0U
+#define MODE_JSON 1U
+#define MODE_SUMMARY 2U
+#define MODE_REPLAY 3U
+
+// Event names
+static const char *const EVENT_NAMES[EVENT_COUNT] =
+{
+	"unknown", "start", "stop", "update", "self_update", "timer", "retry", "clear", "hotkey", "command", "item", "session"
+};
+
+// Option names of the format classes
+static const char *const CLASS_NAMES[CLASS_COUNT] =
+{
+	NULL, "--timeout-text=", "--timeout-rich=", "--timeout-image=", "--timeout-files=", "--timeout-other="
+};
+
+// Statistics
+typedef struct
+{
+	unsigned long segments, records, events[EVENT_COUNT];
+	unsigned long clear_results[3U], retries_max, contention_max, lateness_max;
+	double retries_sum, contention_sum, lateness_sum;
+}
+stats_t;
+
+// Replay state
+typedef struct
+{
+	unsigned int class_timeout[CLASS_COUNT], sensitive_timeout;
+	int text_only;
+}
+policy_t;
+typedef struct
+{
+	policy_t policy;
+	int exposed, halted, skipped, armed;
+	unsigned int classes, timeout;
+	schedule_tick_t now, start, item_start, next_timer;
+	unsigned long items, cleared, skips, manual, replaced, abandoned, wakeups, exposure_max;
+	double exposure_sum;
+}
+replay_t;
+
+// ==========================================================================
+// Helper functions
+// ==========================================================================
+
+static unsigned long get_u32(const unsigned char *const data)
+{
+	return ((unsigned long)data[0U]) | (((unsigned long)data[1U]) << 8) | (((unsigned long)data[2U]) << 16) | (((unsigned long)data[3U]) << 24);
+}
+
+static unsigned int get_u16(const unsigned char *const data)
+{
+	return ((unsigned int)data[0U]) | (((unsigned int)data[1U]) << 8);
+}
+
+static double filetime_to_unix_ms(const unsigned long low, const unsigned long high)
+{
+	const double ticks = (((double)high) * 4294967296.0) + ((double)low);
+	return (ticks - 116444736000000000.0) / 10000.0;
+}
+
+// ==========================================================================
+// Replay
+// ==========================================================================
+
+static void replay_arm(replay_t *const replay)
+{
+	replay->armed = replay->exposed && (!replay->halted) && (!replay->skipped) && replay->timeout;
+	if(replay->armed)
+	{
+		replay->next_timer = replay->now + schedule_delay(replay->now, replay->start, replay->timeout);
+	}
+}
+
+static void replay_expose_end(replay_t *const replay, unsigned long *const counter)
+{
+	if(replay->exposed)
+	{
+		const unsigned long exposure = (unsigned long)(replay->now - replay->item_start);
+		replay->exposure_sum += exposure;
+		if(exposure > replay->exposure_max) replay->exposure_max = exposure;
+		replay->exposed = 0;
+		++(*counter);
+	}
+}
+
+static unsigned int replay_explicit(const policy_t *const policy)
+{
+	unsigned int i, classes = 0U;
+
+	/*same as is_clear_forced(): with TextOnly, a non-zero timeout of a non-textual class was set explicitly*/
+	for(i = CLASS_RICH + 1U; i < CLASS_COUNT; ++i)
+	{
+		if(policy->class_timeout[i])
+		{
+			classes |= 1U << i;
+		}
+	}
+
+	return classes;
+}
+
+static void replay_advance(replay_t *const replay, const schedule_tick_t time)
+{
+	while(replay->armed && (replay->next_timer <= time))
+	{
+		replay->now = replay->next_timer;
+		++replay->wakeups;
+		if(schedule_expired(replay->now, replay->start, replay->timeout))
+		{
+			if(replay->policy.text_only && (!(replay->classes & (CLASS_TEXTUAL | replay_explicit(&replay->policy)))))
+			{
+				++replay->skips;
+				replay->skipped = 1;
+			}
+			else
+			{
+				replay_expose_end(replay, &replay->cleared);
+			}
+			replay->start = replay->now;
+		}
+		replay_arm(replay);
+	}
+	replay->now = time;
+}
+
+static unsigned int replay_timeout(const policy_t *const policy, const unsigned int classes, const unsigned long sensitive)
+{
+	unsigned int i, timeout = 0U;
+
+	for(i = CLASS_TEXT; i < CLASS_COUNT; ++i)
+	{
+		if((classes & (1U << i)) && policy->class_timeout[i] && ((!timeout) || (policy->class_timeout[i] < timeout)))
+		{
+			timeout = policy->class_timeout[i];
+		}
+	}
+
+	if(sensitive && policy->sensitive_timeout && ((!timeout) || (policy->sensitive_timeout < timeout)))
+	{
+		timeout = policy->sensitive_timeout;
+	}
+
+	return timeout;
+}
+
+static void replay_event(replay_t *const replay, const unsigned int type, const unsigned long time, const unsigned int arg0, const unsigned long arg2)
+{
+	replay_advance(replay, time);
+
+	switch(type)
+	{
+	case EVENT_ITEM:
+		replay_expose_end(replay, &replay->replaced);
+		++replay->items;
+		replay->classes = arg0;
+		replay->timeout = replay_timeout(&replay->policy, arg0, arg2);
+		replay->exposed = (arg0 != 0U);
+		replay->skipped = 0;
+		replay->start = replay->item_start = replay->now;
+		break;
+	case EVENT_HOTKEY:
+		replay_expose_end(replay, &replay->manual);
+		replay->start = replay->now;
+		break;
+	case EVENT_COMMAND:
+		if((arg0 == 0U) || (arg0 == 2U))
+		{
+			replay_expose_end(replay, &replay->manual);
+		}
+		else if(arg0 == 3U)
+		{
+			replay->halted = !replay->halted;
+		}
+		replay->start = replay->now;
+		break;
+	case EVENT_STOP:
+		replay_expose_end(replay, &replay->abandoned);
+		break;
+	}
+
+	replay_arm(replay);
+}
+
+static void replay_reset(replay_t *const replay)
+{
+	replay_expose_end(replay, &replay->abandoned);
+	replay->halted = replay->skipped = replay->armed = 0;
+	replay->classes = replay->timeout = 0U;
+	replay->now = replay->start = replay->item_start = replay->next_timer = 0U;
+}
+
+static void print_replay(const replay_t *const replay)
+{
+	const unsigned long ended = replay->cleared + replay->manual + replay->replaced + replay->abandoned;
+
+	printf("items:           %lu\n", replay->items);
+	printf("ended.cleared:   %lu\n", replay->cleared);
+	printf("ended.manual:    %lu\n", replay->manual);
+	printf("ended.replaced:  %lu\n", replay->replaced);
+	printf("ended.abandoned: %lu\n", replay->abandoned);
+	printf("skipped:         %lu\n", replay->skips);
+	printf("wakeups:         %lu\n", replay->wakeups);
+	printf("exposure.total:  %.0f ms\n", replay->exposure_sum);
+	printf("exposure.avg:    %.2f ms\n", ended ? (replay->exposure_sum / ended) : 0.0);
+	printf("exposure.max:    %lu ms\n", replay->exposure_max);
+}
+
+// ==========================================================================
+// Decoder
+// ==========================================================================
+
+static int decode(FILE *const input, const unsigned int mode, stats_t *const stats, replay_t *const replay)
+{
+	unsigned char buffer[HEADER_SIZE];
+	unsigned long start_tick = 0UL, pid = 0UL;
+	double start_time = 0.0;
+	int first = 1;
+
+	if(mode == MODE_CSV)
+	{
+		printf("segment,pid,time_ms,unix_ms,event,arg0,arg1,arg2\n");
+	}
+	else if(mode == MODE_JSON)
+	{
+		printf("[\n");
+	}
+
+	while(fread(buffer, 1U, RECORD_SIZE, input) == RECORD_SIZE)
+	{
+		if((!memcmp(buffer, "CCTR", 4U)) && (get_u16(buffer + 6U) == RECORD_SIZE))
+		{
+			if(fread(buffer + RECORD_SIZE, 1U, HEADER_SIZE - RECORD_SIZE, input) != (HEADER_SIZE - RECORD_SIZE))
+			{
+				fprintf(stderr, "Error: Truncated header!\n");
+				return 0;
+			}
+			if(get_u16(buffer + 4U) != FORMAT_VERSION)
+			{
+				fprintf(stderr, "Error: Unsupported format version %u!\n", get_u16(buffer + 4U));
+				return 0;
+			}
+			start_tick = get_u32(buffer + 8U);
+			pid = get_u32(buffer + 12U);
+			start_time = filetime_to_unix_ms(get_u32(buffer + 16U), get_u32(buffer + 20U));
+			if(mode == MODE_REPLAY)
+			{
+				replay_reset(replay);
+			}
+			++stats->segments;
+			continue;
+		}
+		if(!stats->segments)
+		{
+			fprintf(stderr, "Error: Not a ClearClipboard trace file!\n");
+			return 0;
+		}
+		else
+		{
+			const unsigned long tick = get_u32(buffer), arg1 = get_u32(buffer + 8U), arg2 = get_u32(buffer + 12U);
+			const unsigned int type = get_u16(buffer + 4U), arg0 = get_u16(buffer + 6U);
+			const unsigned long elapsed = (tick - start_tick) & 0xFFFFFFFFUL;
+			const char *const name = EVENT_NAMES[(type < EVENT_COUNT) ? type : 0U];
+			++stats->records;
+			++stats->events[(type < EVENT_COUNT) ? type : 0U];
+			switch(type)
+			{
+			case EVENT_TIMER:
+				stats->lateness_sum += arg1;
+				if(arg1 > stats->lateness_max) stats->lateness_max = arg1;
+				break;
+			case EVENT_CLEAR:
+				++stats->clear_results[(arg0 < 3U) ? arg0 : 0U];
+				stats->retries_sum += arg1;
+				stats->contention_sum += arg2;
+				if(arg1 > stats->retries_max) stats->retries_max = arg1;
+				if(arg2 > stats->contention_max) stats->contention_max = arg2;
+				break;
+			}
+			if(mode == MODE_REPLAY)
+			{
+				replay_event(replay, type, elapsed, arg0, arg2);
+			}
+			else if(mode == MODE_CSV)
+			{
+				printf("%lu,%lu,%lu,%.0f,%s,%u,%lu,%lu\n", stats->segments, pid, elapsed, start_time + elapsed, name, arg0, arg1, arg2);
+			}
+			else if(mode == MODE_JSON)
+			{
+				printf("%s  {\"segment\":%lu,\"pid\":%lu,\"time_ms\":%lu,\"unix_ms\":%.0f,\"event\":\"%s\",\"arg0\":%u,\"arg1\":%lu,\"arg2\":%lu}", first ? "" : ",\n", stats->segments, pid, elapsed, start_time + elapsed, name, arg0, arg1, arg2);
+				first = 0;
+			}
+		}
+	}
+
+	if(mode == MODE_JSON)
+	{
+		printf("\n]\n");
+	}
+	else if(mode == MODE_REPLAY)
+	{
+		replay_reset(replay);
+		if(!stats->events[EVENT_ITEM])
+		{
+			fprintf(stderr, "Error: The trace does not contain any item records!\n");
+			return 0;
+		}
+	}
+
+	return 1;
+}
+
+static void print_summary(const stats_t *const stats)
+{
+	const unsigned long clears = stats->events[EVENT_CLEAR], timers = stats->events[EVENT_TIMER];
+	unsigned int i;
+
+	printf("segments:        %lu\n", stats->segments);
+	printf("records:         %lu\n", stats->records);
+	for(i = 1U; i < EVENT_COUNT; ++i)
+	{
+		printf("events.%-12s %lu\n", EVENT_NAMES[i], stats->events[i]);
+	}
+	printf("clear.cleared:   %lu\n", stats->clear_results[1U]);
+	printf("clear.skipped:   %lu\n", stats->clear_results[2U]);
+	printf("clear.failed:    %lu\n", stats->clear_results[0U]);
+	printf("retries.avg:     %.2f\n", clears ? (stats->retries_sum / clears) : 0.0);
+	printf("retries.max:     %lu\n", stats->retries_max);
+	printf("contention.avg:  %.2f ms\n", clears ? (stats->contention_sum / clears) : 0.0);
+	printf("contention.max:  %lu ms\n", stats->contention_max);
+	printf("lateness.avg:    %.2f ms\n", timers ? (stats->lateness_sum / timers) : 0.0);
+	printf("lateness.max:    %lu ms\n", stats->lateness_max);
+}
+
+// ==========================================================================
+// MAIN
+// ==========================================================================
+
+int main(int argc, char *argv[])
+{
+	unsigned int mode = MODE_CSV;
+	const char *path = NULL;
+	FILE *input;
+	stats_t stats;
+	replay_t replay;
+	unsigned int j, timeout = 30000U;
+	int i, success;
+
+	memset(&replay, 0, sizeof(replay_t));
+	for(j = CLASS_TEXT; j < CLASS_COUNT; ++j)
+	{
+		replay.policy.class_timeout[j] = TIMEOUT_DEFAULT;
+	}
+
+	for(i = 1; i < argc; ++i)
+	{
+		if(!strcmp(argv[i], "--csv"))
+		{
+			mode = MODE_CSV;
+		}
+		else if(!strcmp(argv[i], "--json"))
+		{
+			mode = MODE_JSON;
+		}
+		else if(!strcmp(argv[i], "--summary"))
+		{
+			mode = MODE_SUMMARY;
+		}
+		else if(!strcmp(argv[i], "--replay"))
+		{
+			mode = MODE_REPLAY;
+		}
+		else if(!strncmp(argv[i], "--timeout=", 10U))
+		{
+			timeout = (unsigned int) strtoul(argv[i] + 10U, NULL, 10);
+		}
+		else if(!strncmp(argv[i], "--timeout-sensitive=", 20U))
+		{
+			replay.policy.sensitive_timeout = (unsigned int) strtoul(argv[i] + 20U, NULL, 10);
+		}
+		else if(!strcmp(argv[i], "--text-only"))
+		{
+			replay.policy.text_only = 1;
+		}
+		else if(!strncmp(argv[i], "--timeout-", 10U))
+		{
+			for(j = CLASS_TEXT; j < CLASS_COUNT; ++j)
+			{
+				if(!strncmp(argv[i], CLASS_NAMES[j], strlen(CLASS_NAMES[j])))
+				{
+					replay.policy.class_timeout[j] = (unsigned int) strtoul(argv[i] + strlen(CLASS_NAMES[j]), NULL, 10);
+					break;
+				}
+			}
+			if(j >= CLASS_COUNT)
+			{
+				fprintf(stderr, "Error: Unknown option \"%s\"!\n", argv[i]);
+				return 1;
+			}
+		}
+		else if(!path)
+		{
+			path = argv[i];
+		}
+	}
+
+	/*same derivation as load_settings(): with TextOnly, non-textual classes are not timed, unless set explicitly*/
+	for(j = CLASS_TEXT; j < CLASS_COUNT; ++j)
+	{
+		if(replay.policy.class_timeout[j] == TIMEOUT_DEFAULT)
+		{
+			replay.policy.class_timeout[j] = (replay.policy.text_only && (j > CLASS_RICH)) ? 0U : timeout;
+		}
+	}
+
+	if(!path)
+	{
+		fprintf(stderr, "Usage: TraceDecode [--csv|--json|--summary] <trace_file>\n");
+		fprintf(stderr, "       TraceDecode --replay [--timeout=<ms>] [--timeout-<text|rich|image|files|other>=<ms>] [--timeout-sensitive=<ms>] [--text-only] <trace_file>\n");
+		return 1;
+	}
+
+	if(!(input = fopen(path, "rb")))
+	{
+		fprintf(stderr, "Error: Failed to open \"%s\" for reading!\n", path);
+		return 1;
+	}
+
+	memset(&stats, 0, sizeof(stats_t));
+	success = decode(input, mode, &stats, &replay);
+	fclose(input);
+
+	if(success && (mode == MODE_SUMMARY))
+	{
+		print_summary(&stats);
+	}
+	else if(success && (mode == MODE_REPLAY))
+	{
+		print_replay(&replay);
+	}
+
+	return success ? 0 : 2;
+}